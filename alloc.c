@@ -1,140 +1,1501 @@
 /**
  * Malloc
  */
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
+#ifndef __APPLE__
+#include <malloc.h>
+#endif
 
+#ifndef M_MMAP_THRESHOLD
+#define M_TRIM_THRESHOLD -1
+#define M_TOP_PAD -2
+#define M_MMAP_THRESHOLD -3
+#define M_MMAP_MAX -4
+#endif
+
+// Every block starts with a single word that packs its payload size and its
+// flags. A free block also repeats its size in a footer in the last word of
+// its payload, so the block after it can find its start in constant time.
 typedef struct _metadata_t {
-  size_t size;
-  unsigned char is_used;
+  size_t is_used : 1;
+  size_t prev_free : 1; // the block physically before this one is free
+  size_t is_mmapped : 1; // the block is a mapping of its own, see mmap_block()
+  size_t size : 61;
+} metadata_t;
+
+// A free block keeps its bin links at the start of its payload, where the
+// user's data used to be. Free blocks of at least a page also record when
+// they were freed, see arena_purge(), and large blocks that are kept in a
+// tree rather than a bin use tree links instead of next and prev.
+typedef struct _free_block_t {
   void* next;
   void* prev;
-} metadata_t;
+  uint32_t dirty_since; // ms clock when freed, 0 while its whole pages read as zero, see DIRTY_ENDS
+  void* left; // large blocks only, see tree_insert()
+  void* right;
+  void* parent;
+} free_block_t;
+
+// void* == metadata*
+static free_block_t* links(void* ptr) {
+  return ptr + sizeof(metadata_t);
+}
+
+// Every payload starts on an ALIGNMENT boundary. Headers are half as big, so
+// blocks start ALIGNMENT / 2 bytes past a boundary and span a multiple of
+// ALIGNMENT bytes, header included, see PAYLOAD_SIZE().
+#define ALIGNMENT 16
+#define ALIGN_SIZE(size) (((size) + ALIGNMENT - 1) & ~((size_t) ALIGNMENT - 1))
+
+#ifdef ALLOC_TLSF
+// Two-level segregated fit: the first level splits sizes by power of two and
+// the second level splits each power of two into SL_COUNT linear classes.
+// Sizes below TLSF_SMALL share first level 0 in ALIGNMENT-sized steps.
+#define SL_LOG2 4
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_SHIFT (SL_LOG2 + 4) // log2(SL_COUNT * ALIGNMENT)
+#define TLSF_SMALL (1UL << FL_SHIFT)
+#define FL_COUNT (64 - FL_SHIFT + 1)
+#define NUM_BINS (FL_COUNT * SL_COUNT)
+#else
+// Free blocks up to SMALL_BIN_MAX bytes are kept in segregated bins, one
+// exact-size bin per ALIGNMENT step. Larger free blocks are kept in one
+// tree per arena, ordered by size, for best fit.
+#define NUM_BINS 64
+#define SMALL_BIN_MAX (NUM_BINS * ALIGNMENT)
+#define BIN_MAP_WORDS ((NUM_BINS + 63) / 64)
+#endif
+
+// Every payload is big enough to hold the bin links and footer once freed,
+// and the smallest block worth splitting off is a header plus such a payload.
+// A payload fills its block up to the next multiple of class_spacing, which
+// is ALIGNMENT unless ALLOC_CONF widens it, so that the block after it starts
+// aligned as well. Wider spacing means fewer distinct block sizes, which
+// reuse one another's blocks more readily at the cost of more slack in each.
+// TIGHT_PAYLOAD_SIZE() is the payload at the default spacing, which folds to
+// constants, for the tcache lookup in malloc().
+#define CLASS_SPACING_MAX 4096
+
+static size_t class_spacing = ALIGNMENT; // set by ALLOC_CONF, a power of two
+
+#define MIN_PAYLOAD (2 * sizeof(void*) + sizeof(size_t))
+#define BLOCK_PAYLOAD(size, spacing) ((((size) + sizeof(metadata_t) + (spacing) - 1) & ~((spacing) - 1)) - sizeof(metadata_t))
+#define SPACED_PAYLOAD(size, spacing) (BLOCK_PAYLOAD(size, spacing) < MIN_PAYLOAD ? MIN_PAYLOAD : BLOCK_PAYLOAD(size, spacing))
+#define PAYLOAD_SIZE(size) SPACED_PAYLOAD(size, class_spacing)
+#define TIGHT_PAYLOAD_SIZE(size) SPACED_PAYLOAD(size, (size_t) ALIGNMENT)
+#define MIN_SPLIT (sizeof(metadata_t) + MIN_PAYLOAD)
+
+// Each arena is an independent heap with its own bins and lock. Arena 0 is
+// the sbrk heap; every other arena carves its blocks from one mapping of
+// REGION_SIZE bytes, aligned to REGION_SIZE and starting with the arena_t
+// itself, so the owner of a block in a region is found by masking.
+#define MAX_ARENAS 64
+#define REGION_SIZE (64UL * 1024 * 1024)
+
+// Objects of up to SLAB_MAX_SIZE bytes can be packed into page-sized slabs
+// of equal slots that carry no header, see slab_alloc(). An arena moves a
+// size class to slabs once that class has served SLAB_DEMAND allocations
+// from its heap, so programs with few small objects keep a compact heap.
+#define SLAB_SIZE 4096
+#define SLAB_MAX_SIZE 256
+#define SLAB_CLASSES (SLAB_MAX_SIZE / ALIGNMENT)
+#define SLAB_DEMAND 1024
+#define SLAB_ZONE_SIZE (1UL << 30)
+
+// Small blocks that reach an arena's free path wait in per-size LIFO fast
+// bins, still marked used and uncoalesced, so that the next request of the
+// same size is a single pop. See arena_consolidate().
+#define FAST_BINS 32
+#define FAST_MAX_SIZE (FAST_BINS * ALIGNMENT)
+#define FAST_CONSOLIDATE (64 * 1024)
+
+typedef struct _arena_t {
+  pthread_mutex_t lock;
+  void* start_of_heap;
+  void* end_of_heap;
+  void* end_of_region; // NULL for the sbrk heap, which has no fixed limit
+  void* end_of_top; // sbrk heap: the break, past the cached top chunk
+  void* last_block;
+  void* remote_free; // blocks freed by threads of other arenas, see remote_push()
+  void* fast_free[FAST_BINS]; // deferred small blocks, linked through their payload
+  size_t fast_blocks; // blocks across all fast bins
+  uint32_t last_purge; // ms clock of the last arena_purge()
+  uint32_t oldest_dirty; // no large free block has been dirty since before this; 0 if none is
+  void* head_free[NUM_BINS];
+  void* tail_free[NUM_BINS];
+  void* slabs[SLAB_CLASSES]; // slabs with free slots, per slot size
+  void* empty_slabs; // slabs without live objects, for any slot size
+  unsigned int slab_demand[SLAB_CLASSES]; // heap allocations per slot size
+#ifdef ALLOC_TLSF
+  unsigned long long fl_map;      // bit set => first level has a non-empty bin
+  unsigned int sl_map[FL_COUNT];  // bit set => second level bin is non-empty
+#else
+  unsigned long long bin_map[BIN_MAP_WORDS]; // bit set => bin is non-empty
+  void* large_free; // root of the tree of free blocks above SMALL_BIN_MAX
+#endif
+} arena_t;
 
-void* start_of_heap = NULL;
-void* head_free = NULL;
-void* tail_free = NULL;
+static arena_t main_arena = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static arena_t* arenas[MAX_ARENAS] = { &main_arena };
+static size_t num_arenas = 1;
+static size_t next_arena = 0;
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t page_size = 4096;
+
+#ifdef ALLOC_TLSF
+static size_t bin_index(size_t size) {
+  if (size < TLSF_SMALL) return size / ALIGNMENT;
+  size_t fl = 63 - __builtin_clzl(size);
+  size_t sl = (size >> (fl - SL_LOG2)) ^ SL_COUNT;
+  return (fl - FL_SHIFT + 1) * SL_COUNT + sl;
+}
+
+static void bin_map_set(arena_t* arena, size_t bin) {
+  arena->fl_map |= 1ULL << (bin / SL_COUNT);
+  arena->sl_map[bin / SL_COUNT] |= 1U << (bin % SL_COUNT);
+}
+
+static void bin_map_clear(arena_t* arena, size_t bin) {
+  arena->sl_map[bin / SL_COUNT] &= ~(1U << (bin % SL_COUNT));
+  if (!arena->sl_map[bin / SL_COUNT]) arena->fl_map &= ~(1ULL << (bin / SL_COUNT));
+}
+
+// Returns a free block of at least `size` bytes, or NULL if none exists.
+// The request is rounded up to the next second-level class so that every
+// block in the bin found fits, which keeps the lookup to two bit scans.
+static metadata_t* find_free_block(arena_t* arena, size_t size) {
+  if (size >= TLSF_SMALL) {
+    size_t round = (1UL << (63 - __builtin_clzl(size) - SL_LOG2)) - 1;
+    if (size + round < size) return NULL;
+    size += round;
+  }
+  size_t bin = bin_index(size);
+  size_t fl = bin / SL_COUNT;
+  unsigned int sl_bits = arena->sl_map[fl] & (~0U << (bin % SL_COUNT));
+  if (!sl_bits) {
+    unsigned long long fl_bits = fl + 1 < FL_COUNT ? arena->fl_map & (~0ULL << (fl + 1)) : 0;
+    if (!fl_bits) return NULL;
+    fl = __builtin_ctzll(fl_bits);
+    sl_bits = arena->sl_map[fl];
+  }
+  return arena->head_free[fl * SL_COUNT + __builtin_ctz(sl_bits)];
+}
+
+// Returns 1 if the arena has no free block in any bin.
+static int bins_empty(arena_t* arena) {
+  return !arena->fl_map;
+}
+#else
+static size_t bin_index(size_t size) {
+  return (size / ALIGNMENT) - 1;
+}
+
+static void bin_map_set(arena_t* arena, size_t bin) {
+  arena->bin_map[bin / 64] |= 1ULL << (bin % 64);
+}
+
+static void bin_map_clear(arena_t* arena, size_t bin) {
+  arena->bin_map[bin / 64] &= ~(1ULL << (bin % 64));
+}
+
+// Returns the first non-empty bin at or after `bin`, or NUM_BINS if none.
+static size_t next_bin(arena_t* arena, size_t bin) {
+  size_t word = bin / 64;
+  if (word >= BIN_MAP_WORDS) return NUM_BINS;
+  unsigned long long bits = arena->bin_map[word] & (~0ULL << (bin % 64));
+  while (!bits) {
+    if (++word == BIN_MAP_WORDS) return NUM_BINS;
+    bits = arena->bin_map[word];
+  }
+  return word * 64 + __builtin_ctzll(bits);
+}
+
+// The large free blocks of an arena form a treap ordered by size, then by
+// address. A node's priority is a hash of its address, which keeps the tree
+// balanced in expectation without storing anything besides its three links.
+static uint64_t tree_priority(void* ptr) {
+  return ((uintptr_t) ptr >> 4) * 0x9E3779B97F4A7C15ULL;
+}
 
 // void* == metadata*
-void add_node(void* ptr) {
-  metadata_t* data = ptr;
-  data->prev = tail_free;
-  if (head_free && tail_free) {
-    metadata_t* curr_free = tail_free;
-    curr_free->next = ptr;
-    tail_free = ptr;
-  } else { // No free blocks
-    head_free = ptr;
-    tail_free = ptr;
+static int tree_less(void* ptr, void* other) {
+  metadata_t* block = ptr;
+  metadata_t* other_block = other;
+  return block->size < other_block->size || (block->size == other_block->size && ptr < other);
+}
+
+// void* == metadata*
+// Hangs `child` where `node` hangs from its parent.
+static void tree_replace(arena_t* arena, void* node, void* child) {
+  void* parent = links(node)->parent;
+  if (child) links(child)->parent = parent;
+  if (!parent) arena->large_free = child;
+  else if (links(parent)->left == node) links(parent)->left = child;
+  else links(parent)->right = child;
+}
+
+// void* == metadata*
+// Rotates `node` above its parent, keeping the order of the tree.
+static void tree_rotate_up(arena_t* arena, void* node) {
+  void* parent = links(node)->parent;
+  tree_replace(arena, parent, node);
+  if (links(parent)->left == node) {
+    void* inner = links(node)->right;
+    links(parent)->left = inner;
+    if (inner) links(inner)->parent = parent;
+    links(node)->right = parent;
+  } else {
+    void* inner = links(node)->left;
+    links(parent)->right = inner;
+    if (inner) links(inner)->parent = parent;
+    links(node)->left = parent;
+  }
+  links(parent)->parent = node;
+}
+
+// void* == metadata*
+static void tree_insert(arena_t* arena, void* ptr) {
+  void* parent = NULL;
+  void** link = &arena->large_free;
+  while (*link) {
+    parent = *link;
+    link = tree_less(ptr, parent) ? &links(parent)->left : &links(parent)->right;
   }
+  links(ptr)->left = NULL;
+  links(ptr)->right = NULL;
+  links(ptr)->parent = parent;
+  *link = ptr;
+  while (links(ptr)->parent && tree_priority(links(ptr)->parent) < tree_priority(ptr))
+    tree_rotate_up(arena, ptr);
 }
 
 // void* == metadata*
-size_t delete_node(void* ptr) {
-  if (!head_free) return 1; // failed to delete node because there is no nodes in free_list
-  metadata_t* curr = head_free;
-  metadata_t* prev = curr->prev;
+// Rotates the node down until one of its sides is empty, then splices it out.
+static void tree_remove(arena_t* arena, void* ptr) {
+  free_block_t* node = links(ptr);
+  while (node->left && node->right)
+    tree_rotate_up(arena, tree_priority(node->left) > tree_priority(node->right) ? node->left : node->right);
+  tree_replace(arena, ptr, node->left ? node->left : node->right);
+}
+
+// Returns the smallest large free block of at least `size` bytes, the
+// lowest one among equals, or NULL if none exists.
+static metadata_t* tree_lower_bound(arena_t* arena, size_t size) {
+  metadata_t* best = NULL;
+  metadata_t* curr = arena->large_free;
   while (curr) {
-    if (curr == ptr) {
-      if (head_free == tail_free) { // only one block
-        curr->next = NULL;
-        curr->prev = NULL;
-        head_free = NULL;
-        tail_free = NULL;
-        return 0;
-      }
-      if (prev && tail_free == ptr) tail_free = prev; // set tail_free to previous if ptr is the last node to be deleted
-      head_free == ptr ? (head_free = curr->next) : (prev->next = curr->next);
-      if (curr->next) {
-        metadata_t* temp = curr->next;
-        temp->prev = prev;
-      }
-      return 0; // successfully deleted node
+    if (curr->size >= size) {
+      best = curr;
+      curr = links(curr)->left;
+    } else {
+      curr = links(curr)->right;
     }
-    prev = curr;
-    curr = curr->next;
   }
-  return 1; // failed to delete node as it does not exist or could not find it
+  return best;
+}
+
+// void* == metadata*
+// Returns the next large free block in size order, or NULL.
+static metadata_t* tree_next(void* ptr) {
+  void* node = links(ptr)->right;
+  if (node) {
+    while (links(node)->left) node = links(node)->left;
+    return node;
+  }
+  while ((node = links(ptr)->parent) && links(node)->right == ptr) ptr = node;
+  return node;
+}
+
+// Returns the best fitting free block of at least `size` bytes, or NULL if
+// none exists. Small bins hold exactly one size, so the first non-empty bin
+// at or after the request's fits best; past them, the tree has the answer.
+static metadata_t* find_free_block(arena_t* arena, size_t size) {
+  if (size <= SMALL_BIN_MAX) {
+    size_t bin = next_bin(arena, bin_index(size));
+    if (bin < NUM_BINS) return arena->head_free[bin];
+  }
+  return tree_lower_bound(arena, size);
+}
+
+// Returns 1 if the arena has no free block in any bin or in the tree.
+static int bins_empty(arena_t* arena) {
+  for (size_t word = 0; word < BIN_MAP_WORDS; word++)
+    if (arena->bin_map[word]) return 0;
+  return !arena->large_free;
+}
+#endif
+
+// void* == metadata*
+// Blocks inside the sbrk heap belong to the main arena, any other block to
+// the region it lies in. A region can never overlap the heap's break.
+static arena_t* arena_for(void* ptr) {
+  if (ptr >= main_arena.start_of_heap && ptr < __atomic_load_n(&main_arena.end_of_top, __ATOMIC_RELAXED))
+    return &main_arena;
+  return (arena_t*) ((uintptr_t) ptr & ~(REGION_SIZE - 1));
+}
+
+// void* == metadata*
+static void* next_block(arena_t* arena, void* ptr) {
+  metadata_t* block = ptr;
+  void* next = ptr + sizeof(metadata_t) + block->size;
+  return next < arena->end_of_heap ? next : NULL;
+}
+
+// void* == metadata*
+static void* prev_block(void* ptr) {
+  metadata_t* block = ptr;
+  if (!block->prev_free) return NULL;
+  size_t prev_size = *(size_t*) (ptr - sizeof(size_t));
+  return ptr - prev_size - sizeof(metadata_t);
 }
 
 // void* == metadata*
-void edit_node(void* old_block, void* new_block) {
+// Flags the block free, writes its footer and tells the next block about it.
+static void mark_free(arena_t* arena, void* ptr) {
+  metadata_t* block = ptr;
+  block->is_used = 0;
+  *(size_t*) (ptr + sizeof(metadata_t) + block->size - sizeof(size_t)) = block->size;
+  metadata_t* next = next_block(arena, ptr);
+  if (next) next->prev_free = 1;
+}
+
+// void* == metadata*
+static void mark_used(arena_t* arena, void* ptr) {
+  metadata_t* block = ptr;
+  block->is_used = 1;
+  metadata_t* next = next_block(arena, ptr);
+  if (next) next->prev_free = 0;
+}
+
+// void* == metadata*
+static void add_node(arena_t* arena, void* ptr) {
+  metadata_t* data = ptr;
+#ifndef ALLOC_TLSF
+  if (data->size > SMALL_BIN_MAX) {
+    tree_insert(arena, ptr);
+    return;
+  }
+#endif
+  size_t bin = bin_index(data->size);
+  links(data)->next = NULL;
+  links(data)->prev = arena->tail_free[bin];
+  if (arena->head_free[bin] && arena->tail_free[bin]) {
+    links(arena->tail_free[bin])->next = ptr;
+    arena->tail_free[bin] = ptr;
+  } else { // No free blocks in this bin
+    arena->head_free[bin] = ptr;
+    arena->tail_free[bin] = ptr;
+    bin_map_set(arena, bin);
+  }
+}
+
+// void* == metadata*
+// Unlinks a free block through its own prev/next pointers in constant time.
+static void delete_node(arena_t* arena, void* ptr) {
+  metadata_t* curr = ptr;
+#ifndef ALLOC_TLSF
+  if (curr->size > SMALL_BIN_MAX) {
+    tree_remove(arena, ptr);
+    return;
+  }
+#endif
+  size_t bin = bin_index(curr->size);
+  metadata_t* prev = links(curr)->prev;
+  metadata_t* next = links(curr)->next;
+
+  if (prev) links(prev)->next = next;
+  else arena->head_free[bin] = next;
+  if (next) links(next)->prev = prev;
+  else arena->tail_free[bin] = prev;
+  if (!arena->head_free[bin]) bin_map_clear(arena, bin);
+}
+
+// void* == metadata*
+// Puts new_block where old_block sits in its bin, or re-bins it when the
+// size class changed. old_block->size must still hold its binned size.
+static void edit_node(arena_t* arena, void* old_block, void* new_block) {
   metadata_t* block = old_block;
   metadata_t* new_block_tran = new_block;
-  metadata_t* curr_free = head_free;
-  while (curr_free) {
-    if (curr_free == block) {
-      if ((void*) curr_free == head_free) head_free = new_block;
-      if ((void*) curr_free == tail_free) tail_free = new_block;
-      if (curr_free->prev) {
-        metadata_t* prev = curr_free->prev;
-        prev->next = new_block;
-        new_block_tran->prev = prev;
-      }
-      if (curr_free->next) {
-        metadata_t* next = curr_free->next;
-        next->prev = new_block;
-        new_block_tran->next = next;
-      }
-      return;
-    }
-    curr_free = curr_free->next;
+  size_t bin = bin_index(block->size);
+  if (bin != bin_index(new_block_tran->size)) {
+    delete_node(arena, old_block);
+    add_node(arena, new_block);
+    return;
+  }
+
+  metadata_t* prev = links(block)->prev;
+  metadata_t* next = links(block)->next;
+  links(new_block_tran)->prev = prev;
+  links(new_block_tran)->next = next;
+  if (prev) {
+    links(prev)->next = new_block;
+  } else {
+    arena->head_free[bin] = new_block;
+  }
+  if (next) {
+    links(next)->prev = new_block;
+  } else {
+    arena->tail_free[bin] = new_block;
   }
 }
 
 // void* == metadata*
-void* split_block(void* ptr, size_t size) {
+static void* split_block(arena_t* arena, void* ptr, size_t size) {
   metadata_t* block = ptr;
   size_t block_size = block->size;
-
-  block->size = size;
-  block->is_used = 1;
+#ifndef ALLOC_TLSF
+  // the tree links of a large block reach past a small split, so unlink it
+  // before the new header goes there
+  int in_tree = block_size > SMALL_BIN_MAX;
+  if (in_tree) delete_node(arena, block);
+#endif
 
   // split into two chunks
-  metadata_t* new_block = (void*) block + block->size + sizeof(metadata_t);
+  metadata_t* new_block = (void*) block + size + sizeof(metadata_t);
   new_block->size = block_size - size - sizeof(metadata_t);
-  new_block->is_used = 0;
-  new_block->next = NULL;
-  new_block->prev = NULL;
-  edit_node(block, new_block);
+  new_block->prev_free = 0;
+  new_block->is_mmapped = 0;
+  if (new_block->size >= page_size) links(new_block)->dirty_since = links(block)->dirty_since;
+#ifndef ALLOC_TLSF
+  if (in_tree) add_node(arena, new_block);
+  else
+#endif
+  edit_node(arena, block, new_block);
+  mark_free(arena, new_block);
+  if (arena->last_block == ptr) arena->last_block = new_block;
+
+  block->size = size;
+  block->is_used = 1;
 
   return (void*) ptr + sizeof(metadata_t);
 }
 
 // void* == metadata*
-size_t coalesce_blocks(void* block) {
-  if (!head_free) return 0;
-  metadata_t* curMeta = start_of_heap;
-  void* endOfHeap = sbrk(0);
-  while ((void*) curMeta < endOfHeap) {
-    metadata_t* tempMeta = curMeta;
-    curMeta = (void*) tempMeta + tempMeta->size + sizeof(metadata_t);
-    if ((void*) curMeta > endOfHeap) return 0;
-    if (tempMeta->is_used == 0 && curMeta->is_used == 0) {
-      tempMeta->size += curMeta->size + sizeof(metadata_t);
-      // If the new block is the new face of the TOTAL block,
-      // Then, we must remove the old block from the free list
-      if (tempMeta == block) return delete_node(curMeta);
-      if (curMeta == block) {
-        // coalesce the third free block if it exists
-        metadata_t* third_block = (void*) curMeta + curMeta->size + sizeof(metadata_t);
-        metadata_t* curr_free = head_free;
-        while (curr_free) {
-          if (curr_free == third_block) {
-            tempMeta->size += third_block->size + sizeof(metadata_t);
-            delete_node(third_block);
-          }
-          curr_free = curr_free->next;
-        }
-        // 0: add new block to the end of free list b/c new block is the face of the TOTAL block
-        // 1: do NOT add new block to the end of free list b/c old block is still the face of the TOTAL block
-        return delete_node(curMeta);
+// Merges a newly freed block with its free physical neighbours, which are
+// found through the boundary tags rather than by walking the heap. Returns
+// the face of the TOTAL block, which is not yet in any bin.
+static void* coalesce_blocks(arena_t* arena, void* ptr) {
+  metadata_t* block = ptr;
+
+  metadata_t* next = next_block(arena, block);
+  if (next && next->is_used == 0) {
+    delete_node(arena, next);
+    if (arena->last_block == next) arena->last_block = block;
+    block->size += next->size + sizeof(metadata_t);
+  }
+
+  metadata_t* prev = prev_block(block);
+  if (prev) {
+    delete_node(arena, prev);
+    if (arena->last_block == block) arena->last_block = prev;
+    prev->size += block->size + sizeof(metadata_t);
+    block = prev;
+  }
+
+  return block;
+}
+
+// Takes a block of at least `size` bytes out of the arena's bins, or
+// returns NULL. Caller holds arena->lock.
+static void* arena_find(arena_t* arena, size_t size) {
+  metadata_t* curr = find_free_block(arena, size);
+  if (!curr) return NULL;
+  if (curr->size >= size + MIN_SPLIT) return split_block(arena, curr, size);
+  delete_node(arena, curr);
+  mark_used(arena, curr);
+  return (void*) curr + sizeof(metadata_t);
+}
+
+// With ALLOC_HUGEPAGES=1 in the environment, the heap is laid out for 2 MiB
+// huge pages, which spare large heaps most of their TLB misses. Regions are
+// mapped with MAP_HUGETLB when the system keeps a pool of huge pages, and are
+// otherwise hinted with madvise(MADV_HUGEPAGE), as are the sbrk heap and
+// large mapped blocks. Memory then only goes back to the OS in whole huge
+// pages, so that trimming and purging never split one: release_page is the
+// unit of both.
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+static int hugepages = 0; // set by ALLOC_HUGEPAGES=1
+static size_t release_page = 4096;
+
+// Asks for the whole pages in [ptr, ptr + length) to be backed by huge pages.
+static void hint_huge_pages(void* ptr, size_t length) {
+#ifdef MADV_HUGEPAGE
+  uintptr_t start = ((uintptr_t) ptr + page_size - 1) & ~(page_size - 1);
+  uintptr_t end = ((uintptr_t) ptr + length) & ~(page_size - 1);
+  if (start < end) madvise((void*) start, end - start, MADV_HUGEPAGE);
+#endif
+}
+
+// The sbrk heap grows in chunks: once it holds HEAP_CHUNK_MIN bytes, each
+// sbrk() asks for a sixteenth of the heap, between HEAP_CHUNK_MIN and
+// HEAP_CHUNK_MAX, and new blocks are carved from the cached top chunk
+// between end_of_heap and the break. Smaller heaps grow by what they need.
+// With huge pages, the break always moves to a huge page boundary.
+#define HEAP_CHUNK_MIN (64 * 1024)
+#define HEAP_CHUNK_MAX (2 * 1024 * 1024)
+
+// Makes sure `bytes` more bytes are available after end_of_heap, in the rest
+// of the arena's region or in the top chunk of the sbrk heap. Returns 0 if
+// they are not, which includes the break having been moved by someone else:
+// the heap only grows while it owns everything up to the break. Caller holds
+// arena->lock.
+static int arena_reserve(arena_t* arena, size_t bytes) {
+  if (arena->end_of_region) return bytes <= (size_t) (arena->end_of_region - arena->end_of_heap);
+
+  if (!arena->start_of_heap) {
+    // the first header goes just before an ALIGNMENT boundary
+    void* start = sbrk(0);
+    size_t skew = (uintptr_t) (start + sizeof(metadata_t)) % ALIGNMENT;
+    if (skew && sbrk(ALIGNMENT - skew) == (void*) -1) return 0;
+    arena->start_of_heap = arena->end_of_heap = arena->end_of_top = start + (skew ? ALIGNMENT - skew : 0);
+  }
+  size_t room = arena->end_of_top - arena->end_of_heap;
+  if (bytes <= room) return 1;
+
+  size_t grow = bytes - room;
+  size_t heap = arena->end_of_top - arena->start_of_heap;
+  if (heap >= HEAP_CHUNK_MIN || hugepages) {
+    size_t chunk = heap / 16;
+    if (chunk < HEAP_CHUNK_MIN) chunk = HEAP_CHUNK_MIN;
+    if (chunk > HEAP_CHUNK_MAX) chunk = HEAP_CHUNK_MAX;
+    if (grow < chunk) grow = chunk;
+    grow = (((uintptr_t) arena->end_of_top + grow + release_page - 1) & ~(release_page - 1)) - (uintptr_t) arena->end_of_top;
+  }
+  if (grow > PTRDIFF_MAX) return 0;
+  void* old_break = sbrk(grow);
+  if (old_break == (void*) -1) return 0;
+  if (old_break != arena->end_of_top) {
+    sbrk(-(intptr_t) grow); // not contiguous with the top chunk
+    return 0;
+  }
+  if (hugepages) hint_huge_pages(arena->end_of_top, grow);
+  arena->end_of_top += grow;
+  return 1;
+}
+
+// Carves a used block of `size` bytes, a payload size, off the top of the
+// arena: the room between end_of_heap and the end of its region or of the
+// cached top chunk. Costs a compare and an add; returns NULL when the top is
+// too small. Caller holds arena->lock.
+static void* top_alloc(arena_t* arena, size_t size) {
+  void* top = arena->end_of_region ? arena->end_of_region : arena->end_of_top;
+  if (size + sizeof(metadata_t) > (size_t) (top - arena->end_of_heap)) return NULL;
+  metadata_t* meta = arena->end_of_heap;
+  void* ptr = (void*) meta + sizeof(metadata_t);
+
+  // The header is built aside and stored as one word: setting its fields in
+  // place would read the fresh page first, and fault on it twice
+  int prev_free = arena->last_block && ((metadata_t*) arena->last_block)->is_used == 0;
+  metadata_t header = { .is_used = 1, .prev_free = prev_free, .is_mmapped = 0, .size = size };
+  *meta = header;
+  if (size >= page_size) links(meta)->dirty_since = 0;
+
+  arena->end_of_heap = ptr + size;
+  arena->last_block = meta;
+  return ptr;
+}
+
+// Appends a new block of `size` bytes to the end of the arena's heap, or
+// returns NULL if its region is full. Caller holds arena->lock.
+static void* arena_extend(arena_t* arena, size_t size) {
+  if (size > PTRDIFF_MAX - sizeof(metadata_t) || !arena_reserve(arena, sizeof(metadata_t) + size)) return NULL;
+  return top_alloc(arena, size);
+}
+
+// A free block at the end of an arena that reaches trim_threshold bytes is
+// handed back to the OS, keeping top_pad bytes for the heap to grow into.
+// The sbrk heap shrinks its break; a region arena discards the pages.
+#define DEFAULT_TRIM_THRESHOLD (128 * 1024)
+
+static size_t trim_threshold = DEFAULT_TRIM_THRESHOLD;
+static int trim_threshold_fixed = 0; // set by mallopt(M_TRIM_THRESHOLD)
+static size_t top_pad = 0;
+
+// Gives the arena's memory past new_end, a release_page boundary, back to the
+// OS, including the sbrk heap's cached top chunk. Blocks must already end at
+// or before new_end. Returns 1 if memory was released. Caller holds
+// arena->lock.
+static int arena_release(arena_t* arena, void* new_end) {
+  if (arena->end_of_region) {
+    if (new_end >= arena->end_of_heap) return 0;
+    // on to the next boundary: the rest of that page holds no block
+    void* end = (void*) (((uintptr_t) arena->end_of_heap + release_page - 1) & ~(release_page - 1));
+    // fails on locked pages, which then still hold their data
+    if (madvise(new_end, end - new_end, MADV_DONTNEED) != 0) return 0;
+  } else {
+    if (new_end >= arena->end_of_top) return 0;
+    if (sbrk(0) != arena->end_of_top) return 0; // someone else has moved the break
+    if (sbrk(-(intptr_t) (arena->end_of_top - new_end)) == (void*) -1) return 0;
+    arena->end_of_top = new_end;
+  }
+  return 1;
+}
+
+// void* == metadata*
+// Shrinks the arena's free last block to at least `pad` bytes, ending just
+// before a release_page boundary where the next header would go, and
+// releases the pages after it. The block must not be in a bin. Returns 1 if
+// memory was released. Caller holds arena->lock.
+static int trim_block(arena_t* arena, void* ptr, size_t pad) {
+  metadata_t* block = ptr;
+  if (block != arena->last_block || pad > block->size) return 0;
+  void* new_end = (void*) (((uintptr_t) ptr + 2 * sizeof(metadata_t) + MIN_PAYLOAD + pad + release_page - 1) & ~(release_page - 1));
+  void* end_of_heap = new_end - sizeof(metadata_t);
+  if (end_of_heap >= arena->end_of_heap || !arena_release(arena, new_end)) return 0;
+  block->size = end_of_heap - ptr - sizeof(metadata_t);
+  arena->end_of_heap = end_of_heap;
+  return 1;
+}
+
+// Free blocks of at least PURGE_MIN bytes that stay unused for purge_decay_ms
+// have the whole pages inside them returned with madvise(), so that resident
+// memory follows live data rather than the historical peak. Purging is lazy:
+// it runs from free() and malloc() at most once per decay period, and only
+// once a dirty block may have decayed. With no decay, blocks are purged as
+// they are freed.
+#define PURGE_MIN (64 * 1024)
+#define DEFAULT_PURGE_DECAY_MS 1000
+
+// With huge pages only whole huge pages are discarded, and the partial pages
+// at either end of a purged block are left as they were for calloc() to
+// clear. Its dirty_since then reads DIRTY_ENDS, which no clock value is.
+#define DIRTY_ENDS 2
+
+static uint32_t purge_decay_ms = DEFAULT_PURGE_DECAY_MS;
+
+static uint32_t clock_ms() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t) (now.tv_sec * 1000 + now.tv_nsec / 1000000) | 1; // never 0
+}
+
+// void* == metadata*
+// Discards the release pages between the block's links and its footer. The
+// block stays in its bin and those pages read back as zeros, unless madvise()
+// refused them (locked pages), in which case the block stays dirty.
+static void purge_block(void* ptr) {
+  metadata_t* block = ptr;
+  uintptr_t payload = (uintptr_t) ptr + sizeof(metadata_t);
+  uintptr_t start = (payload + sizeof(free_block_t) + release_page - 1) & ~(release_page - 1);
+  uintptr_t end = (payload + block->size - sizeof(size_t)) & ~(release_page - 1);
+  if (start < end && madvise((void*) start, end - start, MADV_DONTNEED) != 0) return;
+  links(block)->dirty_since = release_page > page_size ? DIRTY_ENDS : 0;
+}
+
+// void* == metadata*
+// Returns the pages in which the block reads as zero between its links and
+// its footer: pages, huge pages after a purge in huge page mode, or 0 while
+// it is dirty.
+static size_t zero_granule(void* ptr) {
+  uint32_t dirty_since = links(ptr)->dirty_since;
+  if (dirty_since == DIRTY_ENDS) return release_page;
+  return dirty_since ? 0 : page_size;
+}
+
+// void* == metadata*
+// Purges the block if it has been dirty for `age` ms, and lowers `oldest` to
+// when it became dirty if it still is.
+static void purge_if_old(void* ptr, uint32_t now, uint32_t age, uint32_t* oldest) {
+  metadata_t* block = ptr;
+  uint32_t dirty_since = block->size >= PURGE_MIN ? links(block)->dirty_since : 0;
+  if (dirty_since && dirty_since != DIRTY_ENDS && now - dirty_since >= age) purge_block(block);
+  dirty_since = block->size >= PURGE_MIN ? links(block)->dirty_since : 0;
+  if (dirty_since && dirty_since != DIRTY_ENDS && (!*oldest || now - dirty_since > now - *oldest)) *oldest = dirty_since;
+}
+
+// Purges every large free block that has been dirty for at least `age` ms,
+// and notes when the oldest of the rest became dirty. Caller holds
+// arena->lock.
+static void arena_purge(arena_t* arena, uint32_t now, uint32_t age) {
+  uint32_t oldest = 0;
+  arena->last_purge = now;
+#ifdef ALLOC_TLSF
+  for (size_t bin = bin_index(PURGE_MIN); bin < NUM_BINS; bin++)
+    for (metadata_t* curr = arena->head_free[bin]; curr; curr = links(curr)->next)
+      purge_if_old(curr, now, age, &oldest);
+#else
+  for (metadata_t* curr = tree_lower_bound(arena, PURGE_MIN); curr; curr = tree_next(curr))
+    purge_if_old(curr, now, age, &oldest);
+#endif
+  arena->oldest_dirty = oldest;
+}
+
+// Purges once the oldest dirty block may have decayed, and a decay period has
+// passed since the last purge, so that a heap that no longer frees large
+// blocks still decays without being walked while nothing is due. Caller
+// holds arena->lock.
+static void arena_purge_due(arena_t* arena, uint32_t now) {
+  if (!arena->oldest_dirty || !purge_decay_ms) return;
+  if (now - arena->oldest_dirty >= purge_decay_ms && now - arena->last_purge >= purge_decay_ms)
+    arena_purge(arena, now, purge_decay_ms);
+}
+
+static void arena_consolidate(arena_t* arena);
+
+// Caller holds arena->lock.
+static void arena_free(arena_t* arena, void* ptr) {
+  metadata_t* meta = ptr;
+  meta->is_used = 0;
+
+  // Add new free block/node
+  meta = coalesce_blocks(arena, meta);
+  if (meta == arena->last_block && meta->size >= trim_threshold) trim_block(arena, meta, top_pad);
+  mark_free(arena, meta);
+  add_node(arena, meta);
+
+  if (meta->size >= PURGE_MIN) {
+    uint32_t now = clock_ms();
+    links(meta)->dirty_since = now;
+    if (!purge_decay_ms) purge_block(meta);
+    else if (!arena->oldest_dirty) arena->oldest_dirty = now;
+    arena_purge_due(arena, now);
+  } else if (meta->size >= page_size) {
+    links(meta)->dirty_since = 1;
+    if (arena->oldest_dirty) arena_purge_due(arena, clock_ms());
+  }
+
+  // a big region is being freed: merge the deferred blocks around it too
+  if (meta->size >= FAST_CONSOLIDATE && arena->fast_blocks) arena_consolidate(arena);
+}
+
+// void* == metadata*
+// Defers freeing a small block: it goes onto its fast bin without
+// coalescing. Caller holds arena->lock.
+static void fast_push(arena_t* arena, void* ptr) {
+  metadata_t* meta = ptr;
+  size_t bin = meta->size / ALIGNMENT - 1;
+  *(void**) (ptr + sizeof(metadata_t)) = arena->fast_free[bin];
+  arena->fast_free[bin] = ptr;
+  arena->fast_blocks++;
+}
+
+// void* == metadata*
+// Returns a deferred block of exactly `size` bytes, or NULL. Caller holds
+// arena->lock.
+static void* fast_pop(arena_t* arena, size_t size) {
+  if (size > FAST_MAX_SIZE || !arena->fast_blocks) return NULL;
+  size_t bin = size / ALIGNMENT - 1;
+  void* ptr = arena->fast_free[bin];
+  if (!ptr) return NULL;
+  arena->fast_free[bin] = *(void**) (ptr + sizeof(metadata_t));
+  arena->fast_blocks--;
+  return ptr;
+}
+
+// Frees every deferred block for real, in one pass, so that they coalesce.
+// Runs when a request finds no free block, when a free coalesces into at
+// least FAST_CONSOLIDATE bytes, and from malloc_trim(). Caller holds
+// arena->lock.
+static void arena_consolidate(arena_t* arena) {
+  arena->fast_blocks = 0; // also keeps arena_free() from consolidating again
+  for (size_t bin = 0; bin < FAST_BINS; bin++) {
+    void* ptr = arena->fast_free[bin];
+    arena->fast_free[bin] = NULL;
+    while (ptr) {
+      void* next = *(void**) (ptr + sizeof(metadata_t));
+      arena_free(arena, ptr);
+      ptr = next;
+    }
+  }
+}
+
+// void* == metadata*
+// Frees a block through the fast bins if it is small. Caller holds
+// arena->lock.
+static void arena_defer(arena_t* arena, void* ptr) {
+  metadata_t* meta = ptr;
+  if (meta->size / ALIGNMENT - 1 < FAST_BINS) fast_push(arena, ptr); // bounded as in tcache_index()
+  else arena_free(arena, ptr);
+}
+
+// void* == metadata*
+// Cuts a used block down to `size` bytes and frees the tail, if the tail is
+// big enough to be a block of its own. Caller holds arena->lock.
+static void shrink_block(arena_t* arena, void* ptr, size_t size) {
+  metadata_t* block = ptr;
+  if (block->size < size + MIN_SPLIT) return;
+
+  metadata_t* tail = ptr + sizeof(metadata_t) + size;
+  tail->size = block->size - size - sizeof(metadata_t);
+  tail->is_used = 1;
+  tail->prev_free = 0;
+  tail->is_mmapped = 0;
+  if (arena->last_block == ptr) arena->last_block = tail;
+  block->size = size;
+  arena_free(arena, tail);
+}
+
+// void* == metadata*
+// Grows a used block in place to at least `size` bytes by absorbing its free
+// right neighbour and, when it is the last block, by extending the heap.
+// Returns 1 on success. Caller holds arena->lock.
+static int grow_block(arena_t* arena, void* ptr, size_t size) {
+  metadata_t* block = ptr;
+  metadata_t* next = next_block(arena, ptr);
+  if (next && next->is_used == 0 &&
+      (block->size + sizeof(metadata_t) + next->size >= size || next == arena->last_block)) {
+    delete_node(arena, next);
+    if (arena->last_block == next) arena->last_block = block;
+    block->size += sizeof(metadata_t) + next->size;
+    mark_used(arena, block);
+  }
+
+  if (block->size < size && block == arena->last_block) {
+    size_t more = size - block->size;
+    if (!arena_reserve(arena, more)) return 0;
+    arena->end_of_heap += more;
+    block->size = size;
+  }
+  if (block->size < size) return 0;
+
+  shrink_block(arena, ptr, size);
+  return 1;
+}
+
+// Slabs are carved from one reservation of SLAB_ZONE_SIZE bytes, so free()
+// tells a slab object from a block by its address alone. Each slab starts
+// with its slab_t and hands out its slots from a free list, then from the
+// never used space at its end. Slabs with free slots sit on their arena's
+// list for that size; full slabs are off the list.
+typedef struct _slab_t {
+  arena_t* arena;
+  void* free_slots; // freed slots, linked through their first word
+  void* unused; // slots from here to the end of the slab were never used
+  struct _slab_t* next;
+  struct _slab_t* prev;
+  unsigned int slot_size;
+  unsigned int used;
+} slab_t;
+
+static void* slab_zone;
+static size_t slab_zone_used;
+
+static int in_slab_zone(void* ptr) {
+  void* zone = __atomic_load_n(&slab_zone, __ATOMIC_RELAXED);
+  return zone && (uintptr_t) (ptr - zone) < SLAB_ZONE_SIZE;
+}
+
+static slab_t* slab_of(void* ptr) {
+  return (slab_t*) ((uintptr_t) ptr & ~((uintptr_t) SLAB_SIZE - 1));
+}
+
+static int slab_full(slab_t* slab) {
+  return !slab->free_slots && slab->unused + slab->slot_size > (void*) slab + SLAB_SIZE;
+}
+
+// Takes a slab from the arena's empty slabs or from the zone, reserving the
+// zone on first use. Caller holds arena->lock.
+static slab_t* slab_create(arena_t* arena, size_t size) {
+  slab_t* slab = arena->empty_slabs;
+  if (slab) {
+    arena->empty_slabs = slab->next;
+  } else {
+    if (!__atomic_load_n(&slab_zone, __ATOMIC_ACQUIRE)) {
+      // No lock: this runs under arena->lock, and lock_arenas() takes
+      // arenas_lock before the arena locks. Racing threads each map a zone
+      // and all but the first unmap theirs.
+      void* zone = mmap(NULL, SLAB_ZONE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (zone == MAP_FAILED) return NULL;
+      void* expected = NULL;
+      if (!__atomic_compare_exchange_n(&slab_zone, &expected, zone, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        munmap(zone, SLAB_ZONE_SIZE);
+    }
+    size_t offset = __atomic_fetch_add(&slab_zone_used, SLAB_SIZE, __ATOMIC_RELAXED);
+    if (offset >= SLAB_ZONE_SIZE) return NULL;
+    slab = slab_zone + offset;
+  }
+  slab->arena = arena;
+  slab->free_slots = NULL;
+  slab->unused = (void*) slab + ALIGN_SIZE(sizeof(slab_t));
+  slab->next = NULL;
+  slab->prev = NULL;
+  slab->slot_size = size;
+  slab->used = 0;
+  return slab;
+}
+
+// Returns a slot of `size` bytes, a multiple of ALIGNMENT, or NULL if the
+// zone is exhausted. Caller holds arena->lock.
+static void* slab_alloc(arena_t* arena, size_t size) {
+  size_t class = size / ALIGNMENT - 1;
+  slab_t* slab = arena->slabs[class];
+  if (!slab) {
+    slab = slab_create(arena, size);
+    if (!slab) return NULL;
+    arena->slabs[class] = slab;
+  }
+
+  void* ptr = slab->free_slots;
+  if (ptr) {
+    slab->free_slots = *(void**) ptr;
+  } else {
+    ptr = slab->unused;
+    slab->unused += size;
+  }
+  slab->used++;
+  if (slab_full(slab)) {
+    arena->slabs[class] = slab->next;
+    if (slab->next) slab->next->prev = NULL;
+    slab->next = NULL;
+  }
+  return ptr;
+}
+
+// Puts a slot back into its slab. A full slab rejoins its size's list; an
+// empty one is kept for any size, unless it is the only slab of its size.
+// Caller holds arena->lock.
+static void slab_free(arena_t* arena, void* ptr) {
+  slab_t* slab = slab_of(ptr);
+  size_t class = slab->slot_size / ALIGNMENT - 1;
+  int was_full = slab_full(slab);
+  *(void**) ptr = slab->free_slots;
+  slab->free_slots = ptr;
+  slab->used--;
+
+  if (was_full) {
+    slab->prev = NULL;
+    slab->next = arena->slabs[class];
+    if (slab->next) slab->next->prev = slab;
+    arena->slabs[class] = slab;
+  } else if (slab->used == 0 && (slab->prev || slab->next)) {
+    if (slab->prev) slab->prev->next = slab->next;
+    else arena->slabs[class] = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+    slab->next = arena->empty_slabs;
+    arena->empty_slabs = slab;
+  }
+}
+
+// void* == metadata*
+// Frees a block that belongs to another thread's arena without taking that
+// arena's lock: the block is pushed onto the owner's lock-free stack with a
+// single CAS, linked through the first word of its payload.
+static void remote_push(arena_t* arena, void* ptr) {
+  void* head = __atomic_load_n(&arena->remote_free, __ATOMIC_RELAXED);
+  do {
+    *(void**) (ptr + sizeof(metadata_t)) = head;
+  } while (!__atomic_compare_exchange_n(&arena->remote_free, &head, ptr, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Frees every block remote threads have pushed so far. The whole stack is
+// detached with one exchange, so pushes never race with the walk below.
+// Caller holds arena->lock.
+static void remote_drain(arena_t* arena) {
+  if (!__atomic_load_n(&arena->remote_free, __ATOMIC_RELAXED)) return;
+  void* ptr = __atomic_exchange_n(&arena->remote_free, NULL, __ATOMIC_ACQUIRE);
+  while (ptr) {
+    void* next = *(void**) (ptr + sizeof(metadata_t));
+    if (in_slab_zone(ptr + sizeof(metadata_t))) slab_free(arena, ptr + sizeof(metadata_t));
+    else arena_defer(arena, ptr);
+    ptr = next;
+  }
+}
+
+// Maps a fresh region with the arena at its start. The mapping is made
+// twice as large as needed so that an aligned region fits, then trimmed.
+static arena_t* arena_create() {
+  void* map = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  // reserved up front, so a short pool fails here rather than on a fault
+  if (hugepages) map = mmap(NULL, 2 * REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (map == MAP_FAILED) map = mmap(NULL, 2 * REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (map == MAP_FAILED) return NULL;
+  void* region = (void*) (((uintptr_t) map + REGION_SIZE - 1) & ~(REGION_SIZE - 1));
+  if (region > map) munmap(map, region - map);
+  munmap(region + REGION_SIZE, map + REGION_SIZE - region);
+  if (hugepages) hint_huge_pages(region, REGION_SIZE);
+
+  arena_t* arena = region; // already zeroed by mmap()
+  pthread_mutex_init(&arena->lock, NULL);
+  arena->start_of_heap = arena->end_of_heap = region + ALIGN_SIZE(sizeof(arena_t) + sizeof(metadata_t)) - sizeof(metadata_t);
+  arena->end_of_region = region + REGION_SIZE;
+  return arena;
+}
+
+// initial-exec: a dlopen()ed allocator must not reach __tls_get_addr, which
+// may itself call malloc()
+static __thread arena_t* thread_arena __attribute__((tls_model("initial-exec")));
+
+// Hands the calling thread an arena, round-robin, creating it on first use.
+static arena_t* arena_attach() {
+  size_t index = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % num_arenas;
+  arena_t* arena = __atomic_load_n(&arenas[index], __ATOMIC_ACQUIRE);
+  if (!arena) {
+    pthread_mutex_lock(&arenas_lock);
+    arena = arenas[index];
+    if (!arena && (arena = arena_create())) __atomic_store_n(&arenas[index], arena, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&arenas_lock);
+    if (!arena) arena = &main_arena;
+  }
+  thread_arena = arena;
+  return arena;
+}
+
+// Requests of at least mmap_threshold bytes get a mapping of their own that
+// free() hands straight back to the OS. As in glibc, freeing a mapped block
+// raises the threshold to that block's size (up to MMAP_THRESHOLD_MAX), so a
+// program that keeps allocating and freeing one large size settles into the
+// heap instead of paying for mmap()/munmap() on every call. The trim
+// threshold follows at twice the mmap threshold so that the heap does not
+// immediately hand such a block's memory back either.
+#define DEFAULT_MMAP_THRESHOLD (128 * 1024)
+#define MMAP_THRESHOLD_MAX (32UL * 1024 * 1024)
+
+static size_t mmap_threshold = DEFAULT_MMAP_THRESHOLD;
+static int mmap_threshold_fixed = 0; // set by mallopt(M_MMAP_THRESHOLD)
+static int mmap_enabled = 1;         // cleared by mallopt(M_MMAP_MAX, 0)
+
+// A mapped block's header lies in the first page of its mapping, so the
+// mapping starts at the header rounded down to a page and ends with the
+// payload.
+static void* mapping_of(void* ptr) {
+  return (void*) ((uintptr_t) ptr & ~(page_size - 1));
+}
+
+// Maps a block of `size` bytes whose payload is aligned to `alignment`, a
+// power of two of at least ALIGNMENT. Alignments above a page over-map by
+// the difference and unmap the unaligned ends.
+static void* mmap_block(size_t alignment, size_t size) {
+  size_t lead = alignment < page_size ? alignment : page_size; // mapping to payload
+  size_t slack = alignment - lead;
+  size_t length = (size + lead + page_size - 1) & ~(page_size - 1);
+  if (length < size || length + slack < length) return NULL;
+  void* map = mmap(NULL, length + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) return NULL;
+  void* start = map;
+  if (slack) {
+    start = (void*) (((uintptr_t) map + lead + alignment - 1) & ~(alignment - 1)) - lead;
+    if (start > map) munmap(map, start - map);
+    if (start < map + slack) munmap(start + length, map + slack - start);
+  }
+
+  if (hugepages && length >= HUGE_PAGE_SIZE) hint_huge_pages(start, length);
+
+  metadata_t* meta = start + lead - sizeof(metadata_t);
+  metadata_t header = { .is_used = 1, .prev_free = 0, .is_mmapped = 1, .size = length - lead };
+  *meta = header; // stored as one word, see top_alloc()
+  links(meta)->dirty_since = 0;
+  return (void*) meta + sizeof(metadata_t);
+}
+
+// void* == metadata*
+static void munmap_block(void* ptr) {
+  metadata_t* meta = ptr;
+  void* map = mapping_of(ptr);
+  size_t length = ptr + sizeof(metadata_t) + meta->size - map;
+  if (!mmap_threshold_fixed && length > mmap_threshold && length <= MMAP_THRESHOLD_MAX) {
+    mmap_threshold = length;
+    if (!trim_threshold_fixed) trim_threshold = 2 * length;
+  }
+  munmap(map, length);
+}
+
+// void* == metadata*
+// Resizes a mapped block to hold `size` bytes with mremap(), which moves page
+// table entries rather than copying data when the mapping cannot grow where
+// it is. Returns the block's new face, or NULL if the caller has to copy.
+static void* remap_block(void* ptr, size_t size) {
+  metadata_t* meta = ptr;
+  void* map = mapping_of(ptr);
+  size_t lead = ptr + sizeof(metadata_t) - map; // kept when the mapping moves
+  size_t length = lead + meta->size;
+  size_t new_length = (size + lead + page_size - 1) & ~(page_size - 1);
+  if (new_length < size) return NULL;
+  if (new_length == length) return ptr;
+#ifdef __APPLE__
+  // no mremap(): shrink by unmapping the tail, grow by copying
+  if (new_length > length || munmap(map + new_length, length - new_length)) return NULL;
+#else
+  map = mremap(map, length, new_length, MREMAP_MAYMOVE);
+  if (map == MAP_FAILED) return NULL;
+  meta = map + lead - sizeof(metadata_t);
+#endif
+  meta->size = new_length - lead;
+  return meta;
+}
+
+// Per-thread cache of small blocks, one LIFO per ALIGNMENT size class up to
+// TCACHE_MAX_SIZE, linked through the first word of each payload. Cached
+// blocks stay marked used in the heap, so hitting the cache takes no lock.
+// Each bin counts down the blocks it still has room for, so that neither a
+// hit nor a free into the cache reads tcache_count.
+#define TCACHE_BINS 32
+#define TCACHE_MAX_SIZE (TCACHE_BINS * ALIGNMENT)
+#define TCACHE_COUNT 16
+#define TCACHE_COUNT_MAX 4096
+
+static unsigned int tcache_count = TCACHE_COUNT; // blocks per bin, set by ALLOC_CONF
+
+typedef struct _tcache_t {
+  void* entries[TCACHE_BINS];
+  unsigned int room[TCACHE_BINS]; // tcache_count less the blocks held
+  size_t cached; // blocks across all bins
+} tcache_t;
+
+static __thread tcache_t* tcache __attribute__((tls_model("initial-exec")));
+static __thread char tcache_shut_down __attribute__((tls_model("initial-exec")));
+static pthread_key_t tcache_key;
+static int alloc_initialized = 0;
+
+// No block is smaller than ALIGNMENT, and a size below it, read from a
+// clobbered header, wraps to a huge index: `tcache_index(size) <
+// TCACHE_BINS` bounds a size at both ends in one compare.
+static size_t tcache_index(size_t size) {
+  return size / ALIGNMENT - 1;
+}
+
+// void* == metadata*
+static void tcache_push(void* ptr) {
+  metadata_t* meta = ptr;
+  size_t bin = tcache_index(meta->size);
+  *(void**) (ptr + sizeof(metadata_t)) = tcache->entries[bin];
+  tcache->entries[bin] = ptr;
+  tcache->room[bin]--;
+  tcache->cached++;
+}
+
+// void* == metadata*
+static void* tcache_pop(size_t bin) {
+  void* ptr = tcache->entries[bin];
+  tcache->entries[bin] = *(void**) (ptr + sizeof(metadata_t));
+  tcache->room[bin]++;
+  tcache->cached--;
+  return ptr;
+}
+
+// Returns cached blocks to their arenas until `bin` holds at most `keep`.
+// Blocks of this thread's arena are freed under one lock; blocks of other
+// arenas go onto their owners' remote stacks. The caller must hold no lock.
+static void tcache_flush(size_t bin, unsigned int keep) {
+  arena_t* locked = NULL;
+  while (tcache_count - tcache->room[bin] > keep) {
+    void* meta = tcache_pop(bin);
+    arena_t* arena = arena_for(meta);
+    if (arena != thread_arena) {
+      remote_push(arena, meta);
+      continue;
+    }
+    if (!locked) {
+      pthread_mutex_lock(&arena->lock);
+      locked = arena;
+    }
+    arena_defer(arena, meta);
+  }
+  if (locked) pthread_mutex_unlock(&locked->lock);
+}
+
+static void tcache_flush_all() {
+  if (!tcache) return;
+  for (size_t bin = 0; tcache->cached; bin++) tcache_flush(bin, 0);
+}
+
+// Moves free blocks of exactly `size` bytes out of the arena and into the
+// cache while the caller already holds arena->lock, so the next few mallocs
+// of this size do not need the lock.
+static void tcache_fill(arena_t* arena, size_t size) {
+  size_t bin = tcache_index(size);
+  while (tcache_count - tcache->room[bin] < tcache_count / 2) {
+    metadata_t* meta = fast_pop(arena, size);
+    if (!meta) {
+      meta = arena->head_free[bin_index(size)];
+      if (!meta || meta->size != size) return;
+      delete_node(arena, meta);
+      mark_used(arena, meta);
+    }
+    tcache_push(meta);
+  }
+}
+
+static void tcache_destroy(void* arg) {
+  tcache_flush_all();
+  munmap(tcache, sizeof(tcache_t));
+  tcache = NULL;
+  tcache_shut_down = 1;
+}
+
+// The cache lives in its own mapping so that neither creating it nor a
+// thread exiting touches the shared heap. Once per thread, so kept out of
+// line rather than grow the free() path it is called from.
+__attribute__((noinline)) static tcache_t* tcache_create() {
+  if (tcache_shut_down) return NULL;
+  tcache_t* cache = mmap(NULL, sizeof(tcache_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (cache == MAP_FAILED) return NULL;
+  for (size_t bin = 0; bin < TCACHE_BINS; bin++) cache->room[bin] = tcache_count;
+  tcache = cache;
+  pthread_setspecific(tcache_key, cache); // flushes the cache on thread exit
+  return cache;
+}
+
+static void lock_arenas() {
+  pthread_mutex_lock(&arenas_lock);
+  for (size_t i = 0; i < MAX_ARENAS; i++)
+    if (arenas[i]) pthread_mutex_lock(&arenas[i]->lock);
+}
+
+static void unlock_arenas() {
+  for (size_t i = 0; i < MAX_ARENAS; i++)
+    if (arenas[i]) pthread_mutex_unlock(&arenas[i]->lock);
+  pthread_mutex_unlock(&arenas_lock);
+}
+
+static void reset_arena_locks() {
+  for (size_t i = 0; i < MAX_ARENAS; i++)
+    if (arenas[i]) pthread_mutex_init(&arenas[i]->lock, NULL);
+  pthread_mutex_init(&arenas_lock, NULL);
+}
+
+static int is_power_of_two(size_t n) {
+  return n && !(n & (n - 1));
+}
+
+static void use_huge_pages(int enable) {
+  hugepages = enable && HUGE_PAGE_SIZE % page_size == 0;
+  release_page = hugepages ? HUGE_PAGE_SIZE : page_size;
+}
+
+// ALLOC_CONF tunes a process without rebuilding the allocator, e.g.
+//   ALLOC_CONF=mmap_threshold:1m,arenas:4,decay_ms:0
+// It is read once, by alloc_init(), as comma-separated key:value pairs whose
+// values take an optional k, m or g suffix:
+//   mmap_threshold  smallest request given its own mapping, fixed as by mallopt()
+//   trim_threshold  free top size at which a heap shrinks, fixed as by mallopt()
+//   arenas          number of arenas, 1 to MAX_ARENAS
+//   tcache          blocks a thread caches per size, 1 to TCACHE_COUNT_MAX
+//   decay_ms        age at which the pages of free blocks are purged
+//   class_spacing   step between block sizes, a power of two from ALIGNMENT
+//                   to CLASS_SPACING_MAX
+//   hugepages       1 for the huge page mode, as ALLOC_HUGEPAGES=1
+// Pairs with an unknown key or a value out of range are ignored. Everything
+// it sets is a plain variable, so the calls that follow pay nothing for it.
+
+// Parses the number in [text, end), or returns 0 if it is not one.
+static int conf_number(const char* text, const char* end, size_t* value) {
+  size_t number = 0;
+  const char* c = text;
+  for (; c < end && *c >= '0' && *c <= '9'; c++) {
+    if (number > (SIZE_MAX - (*c - '0')) / 10) return 0;
+    number = number * 10 + (*c - '0');
+  }
+  if (c == text) return 0;
+
+  size_t shift = 0;
+  if (c < end) {
+    switch (*c++) {
+      case 'k': case 'K': shift = 10; break;
+      case 'm': case 'M': shift = 20; break;
+      case 'g': case 'G': shift = 30; break;
+      default: return 0;
+    }
+  }
+  if (c != end || number > SIZE_MAX >> shift) return 0;
+  *value = number << shift;
+  return 1;
+}
+
+static int conf_key(const char* key, size_t length, const char* name) {
+  return strlen(name) == length && strncmp(key, name, length) == 0;
+}
+
+static void conf_set(const char* key, size_t length, size_t value) {
+  if (conf_key(key, length, "mmap_threshold") && value <= MMAP_THRESHOLD_MAX) {
+    mmap_threshold = value;
+    mmap_threshold_fixed = 1;
+  } else if (conf_key(key, length, "trim_threshold")) {
+    trim_threshold = value;
+    trim_threshold_fixed = 1;
+  } else if (conf_key(key, length, "arenas") && value >= 1 && value <= MAX_ARENAS) {
+    num_arenas = value;
+  } else if (conf_key(key, length, "tcache") && value >= 1 && value <= TCACHE_COUNT_MAX) {
+    tcache_count = value;
+  } else if (conf_key(key, length, "decay_ms") && value <= INT32_MAX) {
+    purge_decay_ms = value;
+  } else if (conf_key(key, length, "class_spacing") && is_power_of_two(value) && value >= ALIGNMENT && value <= CLASS_SPACING_MAX) {
+    class_spacing = value;
+  } else if (conf_key(key, length, "hugepages") && value <= 1) {
+    use_huge_pages(value);
+  }
+}
+
+static void alloc_conf(const char* conf) {
+  while (*conf) {
+    const char* end = strchr(conf, ',');
+    if (!end) end = conf + strlen(conf);
+    const char* colon = memchr(conf, ':', end - conf);
+    size_t value;
+    if (colon && conf_number(colon + 1, end, &value)) conf_set(conf, colon - conf, value);
+    conf = *end ? end + 1 : end;
+  }
+}
+
+static void alloc_init() {
+  // Flag first: pthread_atfork() may itself call malloc()
+  if (__atomic_exchange_n(&alloc_initialized, 1, __ATOMIC_ACQ_REL)) return;
+
+  page_size = sysconf(_SC_PAGESIZE);
+  const char* huge = getenv("ALLOC_HUGEPAGES");
+  use_huge_pages(huge && strcmp(huge, "1") == 0);
+
+  // Two arenas per core keeps threads from queueing on one another's locks
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  num_arenas = cpus > 0 ? 2 * cpus : 1;
+  if (num_arenas > MAX_ARENAS) num_arenas = MAX_ARENAS;
+
+  const char* conf = getenv("ALLOC_CONF");
+  if (conf) alloc_conf(conf);
+
+  pthread_key_create(&tcache_key, tcache_destroy);
+  pthread_atfork(lock_arenas, unlock_arenas, reset_arena_locks);
+}
+
+// Allocates `size` bytes from one arena, taking and releasing its lock.
+static void* arena_malloc(arena_t* arena, size_t size) {
+  pthread_mutex_lock(&arena->lock);
+  remote_drain(arena);
+  if (size <= SLAB_MAX_SIZE) {
+    size_t slot_size = size ? ALIGN_SIZE(size) : ALIGNMENT;
+    size_t class = slot_size / ALIGNMENT - 1;
+    if (arena->slab_demand[class] >= SLAB_DEMAND) {
+      void* ptr = slab_alloc(arena, slot_size);
+      if (ptr) {
+        pthread_mutex_unlock(&arena->lock);
+        return ptr;
       }
+    } else {
+      arena->slab_demand[class]++;
+    }
+  }
+
+  size = PAYLOAD_SIZE(size);
+  void* ptr = fast_pop(arena, size);
+  if (!ptr && bins_empty(arena) && (ptr = top_alloc(arena, size))) {
+    // nothing to search or to fill the cache with: bump off the top
+    pthread_mutex_unlock(&arena->lock);
+    return ptr;
+  }
+  ptr = ptr ? ptr + sizeof(metadata_t) : arena_find(arena, size);
+  if (!ptr && ((tcache && tcache->cached) || arena->fast_blocks)) {
+    // Out of free blocks: hand this thread's cached blocks back and free the
+    // deferred ones so they can coalesce before the heap grows
+    if (tcache && tcache->cached) {
+      pthread_mutex_unlock(&arena->lock);
+      tcache_flush_all();
+      pthread_mutex_lock(&arena->lock);
     }
+    arena_consolidate(arena);
+    ptr = arena_find(arena, size);
   }
-  return 0; // add new block to the end of free list b/c failed coalesce
+  if (!ptr) ptr = arena_extend(arena, size);
+  if (ptr && size <= TCACHE_MAX_SIZE && tcache) tcache_fill(arena, size);
+  if (arena->oldest_dirty) arena_purge_due(arena, clock_ms());
+  pthread_mutex_unlock(&arena->lock);
+  return ptr;
+}
+
+// Cuts `n` used blocks of `size` bytes, a payload size, out of a single free
+// or new block, so that a whole batch costs one search. Returns the number
+// of blocks stored in `out`: `n` or 0. Caller holds arena->lock.
+static size_t arena_carve(arena_t* arena, size_t size, size_t n, void** out) {
+  if (size + sizeof(metadata_t) > PTRDIFF_MAX / n) return 0;
+  size_t total = n * (sizeof(metadata_t) + size) - sizeof(metadata_t);
+  void* ptr = arena_find(arena, total);
+  if (!ptr) ptr = arena_extend(arena, total);
+  if (!ptr) return 0;
+
+  metadata_t* block = ptr - sizeof(metadata_t);
+  int is_last = arena->last_block == block;
+  size_t rest = block->size;
+  for (size_t i = 0; i < n - 1; i++) {
+    out[i] = (void*) block + sizeof(metadata_t);
+    block->size = size;
+    rest -= sizeof(metadata_t) + size;
+    block = (void*) block + sizeof(metadata_t) + size;
+    metadata_t header = { .is_used = 1, .prev_free = 0, .is_mmapped = 0, .size = rest };
+    *block = header; // stored as one word, see top_alloc()
+  }
+  out[n - 1] = (void*) block + sizeof(metadata_t); // keeps any slack
+  if (is_last) arena->last_block = block;
+  return n;
+}
+
+// Allocates up to `n` objects of `size` bytes from one arena under a single
+// lock: slots of the class's slabs while it is in demand, otherwise blocks
+// carved from one heap block. Returns the number stored in `out`.
+static size_t arena_malloc_batch(arena_t* arena, size_t size, size_t n, void** out) {
+  size_t done = 0;
+  pthread_mutex_lock(&arena->lock);
+  remote_drain(arena);
+  if (size <= SLAB_MAX_SIZE) {
+    size_t slot_size = size ? ALIGN_SIZE(size) : ALIGNMENT;
+    size_t class = slot_size / ALIGNMENT - 1;
+    unsigned int demand = arena->slab_demand[class];
+    if (demand < SLAB_DEMAND) arena->slab_demand[class] = n < SLAB_DEMAND - demand ? demand + n : SLAB_DEMAND;
+    if (arena->slab_demand[class] >= SLAB_DEMAND)
+      while (done < n && (out[done] = slab_alloc(arena, slot_size))) done++;
+  }
+  if (done < n) done += arena_carve(arena, PAYLOAD_SIZE(size), n - done, out + done);
+  pthread_mutex_unlock(&arena->lock);
+  return done;
+}
+
+// Allocates `size` bytes, a payload size, aligned to `alignment` from one
+// arena. The block taken is big enough for the aligned payload to leave a
+// block of its own before it; that leading block goes back to the bins, and
+// so does the tail past `size`.
+static void* arena_memalign(arena_t* arena, size_t alignment, size_t size) {
+  pthread_mutex_lock(&arena->lock);
+  remote_drain(arena);
+  size_t padded = size + alignment + MIN_SPLIT;
+  void* ptr = arena_find(arena, padded);
+  if (!ptr) ptr = arena_extend(arena, padded);
+  if (ptr) {
+    metadata_t* block = ptr - sizeof(metadata_t);
+    if ((uintptr_t) ptr & (alignment - 1)) {
+      void* aligned = (void*) (((uintptr_t) ptr + MIN_SPLIT + alignment - 1) & ~(alignment - 1));
+      metadata_t* lead = block;
+      block = aligned - sizeof(metadata_t);
+      block->size = lead->size - (aligned - ptr);
+      block->is_used = 1;
+      block->prev_free = 0;
+      block->is_mmapped = 0;
+      if (arena->last_block == lead) arena->last_block = block;
+      lead->size = aligned - ptr - sizeof(metadata_t);
+      arena_free(arena, lead);
+      ptr = aligned;
+    }
+    shrink_block(arena, block, size);
+  }
+  pthread_mutex_unlock(&arena->lock);
+  return ptr;
+}
+
+// malloc() for any power-of-two alignment.
+static void* aligned_malloc(size_t alignment, size_t size) {
+  if (alignment <= ALIGNMENT) return malloc(size);
+  if (alignment > PTRDIFF_MAX / 2 || size > PTRDIFF_MAX / 2) return NULL;
+  if (!alloc_initialized) alloc_init();
+
+  size_t payload = PAYLOAD_SIZE(size);
+  if (payload >= mmap_threshold && mmap_enabled) {
+    void* ptr = mmap_block(alignment, payload);
+    if (ptr) return ptr;
+  }
+  arena_t* arena = thread_arena ? thread_arena : arena_attach();
+  void* ptr = arena_memalign(arena, alignment, payload);
+  if (!ptr && arena != &main_arena) ptr = arena_memalign(&main_arena, alignment, payload); // region is full
+  if (!ptr && mmap_enabled) ptr = mmap_block(alignment, payload); // the sbrk heap cannot grow
+  return ptr;
 }
 
 /**
@@ -161,9 +1522,27 @@ size_t coalesce_blocks(void* block) {
  * @see http://www.cplusplus.com/reference/clibrary/cstdlib/calloc/
  */
 void* calloc(size_t num, size_t size) {
-  size_t mem_block_size = num * size;
+  size_t mem_block_size;
+  if (__builtin_mul_overflow(num, size, &mem_block_size)) return NULL;
   void* ptr = malloc(mem_block_size);
-  memset(ptr, '\x00', mem_block_size);
+  if (!ptr) return NULL;
+
+  // Blocks fresh from sbrk()/mmap() or purged by madvise() already read as
+  // zero in their whole pages, or in their whole huge pages, so only the
+  // partial pages need clearing
+  metadata_t* meta = (void*) ((uintptr_t) ptr - sizeof(metadata_t));
+  size_t zero_page = mem_block_size < page_size ? 0 : zero_granule(meta);
+  if (!zero_page) {
+    memset(ptr, '\x00', mem_block_size);
+    return ptr;
+  }
+  void* head = (void*) (((uintptr_t) ptr + sizeof(free_block_t) + zero_page - 1) & ~(zero_page - 1));
+  void* tail = (void*) (((uintptr_t) ptr + meta->size - sizeof(size_t)) & ~(zero_page - 1));
+  // either partial page may reach past the request, or before its start
+  void* end = ptr + mem_block_size;
+  memset(ptr, '\x00', (head < end ? head : end) - ptr);
+  if (tail < ptr) tail = ptr;
+  if (end > tail) memset(tail, '\x00', end - tail);
   return ptr;
 }
 
@@ -190,29 +1569,60 @@ void* calloc(size_t num, size_t size) {
  */
 
 void* malloc(size_t size) {
-  if (!start_of_heap) start_of_heap = sbrk(0);
-  metadata_t* curr = head_free;
-
-  while (curr) {
-    if (curr->size == size) {
-      delete_node(curr);
-      curr->is_used = 1;
-      return (void*) curr + sizeof(metadata_t);
-    }
-    if (curr->size > size + sizeof(metadata_t)) return split_block(curr, size);
-    curr = curr->next;
+  if (size > PTRDIFF_MAX) return NULL;
+  // A block of the tight payload fits the request at any spacing, and with
+  // the default one it is the block the request would get anyway. A wider
+  // spacing's bin is only read once the tight one misses.
+  size_t bin = tcache_index(TIGHT_PAYLOAD_SIZE(size));
+  if (bin < TCACHE_BINS && tcache) {
+    if (tcache->entries[bin]) return tcache_pop(bin) + sizeof(metadata_t);
+    bin = tcache_index(PAYLOAD_SIZE(size));
+    if (bin < TCACHE_BINS && tcache->entries[bin]) return tcache_pop(bin) + sizeof(metadata_t);
   }
 
-  metadata_t* meta = sbrk(sizeof(metadata_t));
-  meta->size = size;
-  meta->is_used = 1;
-  meta->next = NULL;
-  meta->prev = NULL;
+  if (!alloc_initialized) alloc_init();
+  size_t payload = PAYLOAD_SIZE(size);
+  if (payload >= mmap_threshold && mmap_enabled) {
+    void* ptr = mmap_block(ALIGNMENT, payload);
+    if (ptr) return ptr;
+  }
+  if (payload <= TCACHE_MAX_SIZE && !tcache) tcache_create();
+  arena_t* arena = thread_arena ? thread_arena : arena_attach();
 
-  return sbrk(size);
+  void* ptr = arena_malloc(arena, size);
+  if (!ptr && arena != &main_arena) ptr = arena_malloc(&main_arena, size); // region is full
+  if (!ptr && mmap_enabled) ptr = mmap_block(ALIGNMENT, payload); // the sbrk heap cannot grow
+  return ptr;
 }
 
 
+// void* == metadata*
+// Frees a block of the heap or a mapping, anything but a slab object.
+static void free_block(void* ptr) {
+  metadata_t* meta = ptr;
+  if (meta->is_mmapped) {
+    munmap_block(meta);
+    return;
+  }
+
+  size_t bin = tcache_index(meta->size);
+  if (bin < TCACHE_BINS && (tcache || tcache_create())) {
+    // Full: hand half of this class back in one pass
+    if (!tcache->room[bin]) tcache_flush(bin, tcache_count / 2);
+    tcache_push(meta);
+    return;
+  }
+
+  arena_t* arena = arena_for(meta);
+  if (arena != thread_arena) {
+    remote_push(arena, meta); // never blocks on another thread's arena
+    return;
+  }
+  pthread_mutex_lock(&arena->lock);
+  arena_free(arena, meta);
+  pthread_mutex_unlock(&arena->lock);
+}
+
 /**
  * Deallocate space in memory
  *
@@ -230,11 +1640,19 @@ void* malloc(size_t size) {
  *    passed as argument, no action occurs.
  */
 void free(void *ptr) {
-  metadata_t* meta = ptr - sizeof(metadata_t);
-  meta->is_used = 0;
-
-  // Add new free block/node
-  if (!head_free || coalesce_blocks(meta) == 0) add_node(meta);
+  if (!ptr) return;
+  if (in_slab_zone(ptr)) {
+    arena_t* arena = slab_of(ptr)->arena;
+    if (arena != thread_arena) {
+      remote_push(arena, ptr - sizeof(metadata_t));
+      return;
+    }
+    pthread_mutex_lock(&arena->lock);
+    slab_free(arena, ptr);
+    pthread_mutex_unlock(&arena->lock);
+    return;
+  }
+  free_block(ptr - sizeof(metadata_t));
 }
 
 /**
@@ -289,12 +1707,384 @@ void* realloc(void *ptr, size_t size) {
     return NULL;
   }
 
+  if (size > PTRDIFF_MAX) return NULL;
+
+  if (in_slab_zone(ptr)) {
+    size_t slot_size = slab_of(ptr)->slot_size;
+    if (size <= slot_size) return ptr;
+    void* new_ptr = malloc(size);
+    if (!new_ptr) return NULL;
+    memcpy(new_ptr, ptr, slot_size);
+    free(ptr);
+    return new_ptr;
+  }
+
   metadata_t* block = (void*) ptr - sizeof(metadata_t);
-  if (block->size >= size) return ptr;
-  
+  if (block->is_mmapped) {
+    // let the kernel resize or move the mapping
+    metadata_t* moved = remap_block(block, size);
+    if (moved) return (void*) moved + sizeof(metadata_t);
+    if (block->size >= size) return ptr;
+  } else if (block->size >= size) {
+    // give back the tail, if it is worth a block of its own
+    if (block->size >= PAYLOAD_SIZE(size) + MIN_SPLIT) {
+      arena_t* arena = arena_for(block);
+      pthread_mutex_lock(&arena->lock);
+      shrink_block(arena, block, PAYLOAD_SIZE(size));
+      pthread_mutex_unlock(&arena->lock);
+    }
+    return ptr;
+  } else {
+    // grow in place into free space after the block
+    arena_t* arena = arena_for(block);
+    pthread_mutex_lock(&arena->lock);
+    int grown = grow_block(arena, block, PAYLOAD_SIZE(size));
+    pthread_mutex_unlock(&arena->lock);
+    if (grown) return ptr;
+  }
+
   // transport to new location
   void* new_ptr = malloc(size);
+  if (!new_ptr) return NULL;
   memcpy(new_ptr, ptr, block->size);
   free(ptr);
   return new_ptr;
-}
\ No newline at end of file
+}
+
+/**
+ * Set memory allocation parameters
+ *
+ * Supports the glibc parameters that apply to this allocator:
+ * M_MMAP_THRESHOLD sets the smallest request served by its own mapping and
+ * stops the threshold from adapting; M_MMAP_MAX with a value of 0 turns the
+ * mmap() path off; M_TRIM_THRESHOLD sets the size a free block at the top of
+ * the heap must reach before it is released, and M_TOP_PAD how much of it
+ * is kept.
+ *
+ * @param param
+ *    Parameter to change.
+ * @param value
+ *    New value of the parameter.
+ *
+ * @return
+ *    1 on success, 0 if the parameter or value is not supported.
+ */
+int mallopt(int param, int value) {
+  if (!alloc_initialized) alloc_init(); // ALLOC_CONF first, so that this wins
+  switch (param) {
+    case M_MMAP_THRESHOLD:
+      if (value < 0 || (size_t) value > MMAP_THRESHOLD_MAX) return 0;
+      mmap_threshold = value;
+      mmap_threshold_fixed = 1;
+      return 1;
+    case M_MMAP_MAX:
+      mmap_enabled = value != 0;
+      return 1;
+    case M_TRIM_THRESHOLD:
+      if (value < 0) return 0;
+      trim_threshold = value;
+      trim_threshold_fixed = 1;
+      return 1;
+    case M_TOP_PAD:
+      if (value < 0) return 0;
+      top_pad = value;
+      return 1;
+  }
+  return 0;
+}
+
+/**
+ * Release free memory from the top of the heap
+ *
+ * Returns this thread's cached blocks to their arenas, then shrinks every
+ * arena whose last block is free down to pad bytes, regardless of the trim
+ * threshold, and purges the pages of every large free block without waiting
+ * for them to decay. Long-running processes can call it after a burst to give the
+ * memory back to the OS.
+ *
+ * @param pad
+ *    Number of free bytes to keep at the top of each heap.
+ *
+ * @return
+ *    1 if any memory was released, 0 otherwise.
+ */
+int malloc_trim(size_t pad) {
+  tcache_flush_all();
+  int released = 0;
+  for (size_t i = 0; i < MAX_ARENAS; i++) {
+    arena_t* arena = __atomic_load_n(&arenas[i], __ATOMIC_ACQUIRE);
+    if (!arena) continue;
+    pthread_mutex_lock(&arena->lock);
+    remote_drain(arena);
+    arena_consolidate(arena);
+    metadata_t* last = arena->last_block;
+    if (last && last->is_used == 0) {
+      delete_node(arena, last);
+      released |= trim_block(arena, last, pad);
+      mark_free(arena, last);
+      add_node(arena, last);
+    } else if (arena->end_of_heap) {
+      released |= arena_release(arena, (void*) (((uintptr_t) arena->end_of_heap + pad + release_page - 1) & ~(release_page - 1)));
+    }
+    arena_purge(arena, clock_ms(), 0);
+    pthread_mutex_unlock(&arena->lock);
+  }
+  return released;
+}
+
+/**
+ * Allocate aligned memory block
+ *
+ * Allocates size bytes and places the address of the allocated memory in
+ * *memptr. The address is a multiple of alignment, which must be a power of
+ * two multiple of sizeof(void*). The memory is not initialized and is
+ * released with free().
+ *
+ * @param memptr
+ *    Where the address of the allocated memory is stored.
+ * @param alignment
+ *    Alignment of the memory block, in bytes.
+ * @param size
+ *    Size of the memory block, in bytes.
+ *
+ * @return
+ *    0 on success, EINVAL if alignment is not supported, or ENOMEM if the
+ *    memory could not be allocated. *memptr is left unchanged on failure.
+ */
+int posix_memalign(void** memptr, size_t alignment, size_t size) {
+  if (!is_power_of_two(alignment) || alignment % sizeof(void*)) return EINVAL;
+  void* ptr = aligned_malloc(alignment, size);
+  if (!ptr) return ENOMEM;
+  *memptr = ptr;
+  return 0;
+}
+
+/**
+ * Allocate aligned memory block
+ *
+ * The C11 interface to posix_memalign(): allocates size bytes at an address
+ * that is a multiple of alignment, which must be a power of two.
+ *
+ * @param alignment
+ *    Alignment of the memory block, in bytes.
+ * @param size
+ *    Size of the memory block, in bytes.
+ *
+ * @return
+ *    A pointer to the memory block, or NULL with errno set to EINVAL if the
+ *    alignment is not a power of two.
+ */
+void* aligned_alloc(size_t alignment, size_t size) {
+  if (!is_power_of_two(alignment)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return aligned_malloc(alignment, size);
+}
+
+/**
+ * Allocate aligned memory block
+ *
+ * Obsolete form of aligned_alloc(). As in glibc, an alignment that is not a
+ * power of two is rounded up to the next one.
+ *
+ * @param alignment
+ *    Alignment of the memory block, in bytes.
+ * @param size
+ *    Size of the memory block, in bytes.
+ *
+ * @return
+ *    A pointer to the memory block, or NULL on failure.
+ */
+void* memalign(size_t alignment, size_t size) {
+  if (alignment > PTRDIFF_MAX) return NULL;
+  if (!is_power_of_two(alignment)) alignment = alignment ? 1UL << (64 - __builtin_clzl(alignment)) : 1;
+  return aligned_malloc(alignment, size);
+}
+
+/**
+ * Allocate page-aligned memory block
+ *
+ * @param size
+ *    Size of the memory block, in bytes.
+ *
+ * @return
+ *    A pointer to the memory block, aligned to the page size, or NULL on
+ *    failure.
+ */
+void* valloc(size_t size) {
+  if (!alloc_initialized) alloc_init();
+  return aligned_malloc(page_size, size);
+}
+
+/**
+ * Allocate page-aligned whole pages
+ *
+ * Like valloc(), but rounds size up to a multiple of the page size.
+ *
+ * @param size
+ *    Size of the memory block, in bytes.
+ *
+ * @return
+ *    A pointer to the memory block, or NULL on failure.
+ */
+void* pvalloc(size_t size) {
+  if (!alloc_initialized) alloc_init();
+  size_t pages = (size + page_size - 1) & ~(page_size - 1);
+  if (pages < size) return NULL;
+  return aligned_malloc(page_size, pages ? pages : page_size);
+}
+
+/**
+ * Obtain size of block of memory allocated from heap
+ *
+ * Returns the number of bytes that can be used in the block pointed to by
+ * ptr, which may be more than was requested. Writing up to that many bytes
+ * is safe, and realloc() to any size up to it returns ptr unchanged.
+ *
+ * @param ptr
+ *    Pointer to a memory block previously allocated with malloc(),
+ *    calloc(), realloc() or an aligned allocation call, or NULL.
+ *
+ * @return
+ *    The usable size of the block, or 0 if ptr is NULL.
+ */
+size_t malloc_usable_size(void* ptr) {
+  if (!ptr) return 0;
+  if (in_slab_zone(ptr)) return slab_of(ptr)->slot_size;
+  metadata_t* meta = ptr - sizeof(metadata_t);
+  return meta->size;
+}
+
+#ifdef DEBUG
+// A block can be larger than the size it was asked for, but never smaller:
+// debug builds abort on a sized free whose size the block cannot hold.
+static void check_freed_size(void* ptr, size_t size) {
+  if (!ptr || size <= malloc_usable_size(ptr)) return;
+  static const char message[] = "free_sized(): size larger than the block\n";
+  write(STDERR_FILENO, message, sizeof(message) - 1);
+  abort();
+}
+#else
+#define check_freed_size(ptr, size)
+#endif
+
+/**
+ * Deallocate space in memory of a known size
+ *
+ * Equivalent to free(ptr) for a block allocated with malloc(), calloc() or
+ * realloc() whose last requested size was size. Blocks too big for a slab
+ * skip the slab lookup. The header is read all the same, since a block of
+ * any size may be a mapping after realloc() shrinks it. Debug builds abort
+ * if the block cannot hold size.
+ *
+ * @param ptr
+ *    Pointer to the memory block to deallocate, or NULL.
+ * @param size
+ *    Size that was requested for the block.
+ */
+void free_sized(void* ptr, size_t size) {
+  check_freed_size(ptr, size);
+  if (size <= SLAB_MAX_SIZE) free(ptr);
+  else if (ptr) free_block(ptr - sizeof(metadata_t));
+}
+
+/**
+ * Deallocate aligned space in memory of a known size
+ *
+ * Equivalent to free(ptr) for a block allocated with aligned_alloc() with
+ * the same alignment and size. Blocks aligned beyond ALIGNMENT never come
+ * from a slab and skip the slab lookup.
+ *
+ * @param ptr
+ *    Pointer to the memory block to deallocate, or NULL.
+ * @param alignment
+ *    Alignment that was requested for the block.
+ * @param size
+ *    Size that was requested for the block.
+ */
+void free_aligned_sized(void* ptr, size_t alignment, size_t size) {
+  if (alignment <= ALIGNMENT) {
+    free_sized(ptr, size);
+    return;
+  }
+  check_freed_size(ptr, size);
+  if (ptr) free_block(ptr - sizeof(metadata_t));
+}
+
+/**
+ * Allocate many memory blocks of one size
+ *
+ * Allocates n blocks of size bytes each and stores them in out[0] through
+ * out[n - 1]. The whole batch takes one arena lock: small sizes fill slab
+ * slots, other sizes are cut from one free block, so the blocks of a batch
+ * are usually contiguous. Each block is released with free() or
+ * free_batch().
+ *
+ * @param size
+ *    Size of each memory block, in bytes.
+ * @param n
+ *    Number of blocks to allocate.
+ * @param out
+ *    Array of at least n pointers that receives the blocks.
+ *
+ * @return
+ *    The number of blocks allocated. It is less than n only if memory ran
+ *    out, in which case the first entries of out hold the blocks that were
+ *    allocated.
+ */
+size_t malloc_batch(size_t size, size_t n, void** out) {
+  if (size > PTRDIFF_MAX || !n) return 0;
+  if (!alloc_initialized) alloc_init();
+
+  size_t done = 0;
+  if (PAYLOAD_SIZE(size) >= mmap_threshold && mmap_enabled) {
+    // mapped blocks gain nothing from batching
+    while (done < n && (out[done] = malloc(size))) done++;
+    return done;
+  }
+  arena_t* arena = thread_arena ? thread_arena : arena_attach();
+  done = arena_malloc_batch(arena, size, n, out);
+  if (done < n && arena != &main_arena) done += arena_malloc_batch(&main_arena, size, n - done, out + done); // region is full
+  while (done < n && (out[done] = malloc(size))) done++; // too big to carve at once
+  return done;
+}
+
+/**
+ * Deallocate many memory blocks
+ *
+ * Frees every non-NULL pointer in ptrs[0] through ptrs[n - 1], as free()
+ * would, but takes this thread's arena lock only once for the whole batch.
+ * The blocks skip the thread cache and coalesce at once, so a batch from
+ * malloc_batch() merges back into one free block.
+ *
+ * @param ptrs
+ *    Array of n pointers to free.
+ * @param n
+ *    Number of pointers in ptrs.
+ */
+void free_batch(void** ptrs, size_t n) {
+  arena_t* locked = NULL;
+  for (size_t i = 0; i < n; i++) {
+    void* ptr = ptrs[i];
+    if (!ptr) continue;
+    metadata_t* meta = ptr - sizeof(metadata_t);
+    int is_slab = in_slab_zone(ptr);
+    if (!is_slab && meta->is_mmapped) {
+      munmap_block(meta);
+      continue;
+    }
+    arena_t* arena = is_slab ? slab_of(ptr)->arena : arena_for(meta);
+    if (arena != thread_arena) {
+      remote_push(arena, meta);
+      continue;
+    }
+    if (!locked) {
+      pthread_mutex_lock(&arena->lock);
+      locked = arena;
+    }
+    if (is_slab) slab_free(arena, ptr);
+    else arena_free(arena, meta);
+  }
+  if (locked) pthread_mutex_unlock(&locked->lock);
+}
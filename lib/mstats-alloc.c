@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <stdint.h>
 #include <string.h>
 #include <dlfcn.h>
 #include <sys/types.h>
@@ -27,11 +28,27 @@ void *(*alloc_calloc)(size_t nmemb, size_t size) = NULL;
 void *(*alloc_malloc)(size_t size) = NULL;
 void  (*alloc_free)(void *ptr) = NULL;
 void *(*alloc_realloc)(void *ptr, size_t size) = NULL;
+int   (*alloc_posix_memalign)(void **memptr, size_t alignment, size_t size) = NULL;
+void *(*alloc_aligned_alloc)(size_t alignment, size_t size) = NULL;
+void *(*alloc_memalign)(size_t alignment, size_t size) = NULL;
+void *(*alloc_valloc)(size_t size) = NULL;
+void *(*alloc_pvalloc)(size_t size) = NULL;
+size_t (*alloc_malloc_usable_size)(void *ptr) = NULL;
+void  (*alloc_free_sized)(void *ptr, size_t size) = NULL;
+void  (*alloc_free_aligned_sized)(void *ptr, size_t alignment, size_t size) = NULL;
+size_t (*alloc_malloc_batch)(size_t size, size_t n, void **out) = NULL;
+void  (*alloc_free_batch)(void **ptrs, size_t n) = NULL;
 
 void *(*libc_calloc)(size_t nmemb, size_t size) = NULL;
 void *(*libc_malloc)(size_t size) = NULL;
 void (*libc_free)(void *ptr) = NULL;
 void *(*libc_realloc)(void *ptr, size_t size) = NULL;
+int   (*libc_posix_memalign)(void **memptr, size_t alignment, size_t size) = NULL;
+void *(*libc_aligned_alloc)(size_t alignment, size_t size) = NULL;
+void *(*libc_memalign)(size_t alignment, size_t size) = NULL;
+void *(*libc_valloc)(size_t size) = NULL;
+void *(*libc_pvalloc)(size_t size) = NULL;
+size_t (*libc_malloc_usable_size)(void *ptr) = NULL;
 
 #ifdef __APPLE__
 void *(*mmap_sbrk)(intptr_t increment) = NULL;
@@ -71,6 +88,12 @@ void stats_alloc_init() {
 	libc_malloc  = dlsym(RTLD_NEXT, "malloc");
 	libc_free    = dlsym(RTLD_NEXT, "free");
 	libc_realloc = dlsym(RTLD_NEXT, "realloc");
+	libc_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+	libc_aligned_alloc  = dlsym(RTLD_NEXT, "aligned_alloc");
+	libc_memalign       = dlsym(RTLD_NEXT, "memalign");
+	libc_valloc         = dlsym(RTLD_NEXT, "valloc");
+	libc_pvalloc        = dlsym(RTLD_NEXT, "pvalloc");
+	libc_malloc_usable_size = dlsym(RTLD_NEXT, "malloc_usable_size");
 
   #ifdef __APPLE__
   libc_sbrk    = dlsym(RTLD_NEXT, "sbrk");
@@ -104,6 +127,12 @@ void stats_alloc_init() {
 	alloc_malloc  = libc_malloc;
 	alloc_free    = libc_free;
 	alloc_realloc = libc_realloc;	
+	alloc_posix_memalign = libc_posix_memalign;
+	alloc_aligned_alloc  = libc_aligned_alloc;
+	alloc_memalign       = libc_memalign;
+	alloc_valloc         = libc_valloc;
+	alloc_pvalloc        = libc_pvalloc;
+	alloc_malloc_usable_size = libc_malloc_usable_size;
 	#else		
 	alloc_handle = dlopen("./alloc.so", RTLD_NOW | RTLD_GLOBAL);
 	if (!alloc_handle) {
@@ -118,8 +147,21 @@ void stats_alloc_init() {
 	alloc_malloc  = dlsym(alloc_handle, "malloc");
 	alloc_free    = dlsym(alloc_handle, "free");
 	alloc_realloc = dlsym(alloc_handle, "realloc");
-
-	if (!alloc_calloc || !alloc_malloc || !alloc_free || !alloc_realloc) {
+	alloc_posix_memalign = dlsym(alloc_handle, "posix_memalign");
+	alloc_aligned_alloc  = dlsym(alloc_handle, "aligned_alloc");
+	alloc_memalign       = dlsym(alloc_handle, "memalign");
+	alloc_valloc         = dlsym(alloc_handle, "valloc");
+	alloc_pvalloc        = dlsym(alloc_handle, "pvalloc");
+	alloc_malloc_usable_size = dlsym(alloc_handle, "malloc_usable_size");
+	alloc_free_sized         = dlsym(alloc_handle, "free_sized");
+	alloc_free_aligned_sized = dlsym(alloc_handle, "free_aligned_sized");
+	alloc_malloc_batch       = dlsym(alloc_handle, "malloc_batch");
+	alloc_free_batch         = dlsym(alloc_handle, "free_batch");
+
+	if (!alloc_calloc || !alloc_malloc || !alloc_free || !alloc_realloc ||
+	    !alloc_posix_memalign || !alloc_aligned_alloc || !alloc_memalign || !alloc_valloc || !alloc_pvalloc ||
+	    !alloc_malloc_usable_size || !alloc_free_sized || !alloc_free_aligned_sized ||
+	    !alloc_malloc_batch || !alloc_free_batch) {
 		fprintf(stderr, "Unable to dynamicly load a required memory allocation call.\n");
 		exit(66);
 	}
@@ -138,6 +180,7 @@ void stats_alloc_init() {
 	stats->max_heap_used = 0;
 	stats->memory_heap_sum = 0;
 	stats->memory_uses = 0;
+	stats->max_huge_pages_used = 0;
 	
 	sbrk_init_done = sbrk(0);
 	sbrk_start = sbrk_largest = sbrk(0);
@@ -145,6 +188,42 @@ void stats_alloc_init() {
 }
 
 
+/*
+ * Returns the bytes of the process backed by huge pages, transparent or from
+ * hugetlbfs, as /proc/self/smaps_rollup reports them (0 where it does not
+ * exist).  Reads into the stack, as malloc() cannot be called from here.
+ */
+unsigned long long huge_pages_used() {
+	char text[4096];
+	int fd = open("/proc/self/smaps_rollup", O_RDONLY);
+	if (fd < 0) { return 0; }
+	ssize_t len = read(fd, text, sizeof(text) - 1);
+	close(fd);
+	if (len <= 0) { return 0; }
+	text[len] = '\0';
+
+	const char *fields[] = { "AnonHugePages:", "Shared_Hugetlb:", "Private_Hugetlb:" };
+	unsigned long long total = 0;
+	for (int i = 0; i < 3; i++) {
+		char *line = strstr(text, fields[i]);
+		if (line) { total += strtoull(line + strlen(fields[i]), NULL, 10) * 1024; }
+	}
+	return total;
+}
+
+void huge_pages_tracking() {
+	unsigned long long current_huge_pages = huge_pages_used();
+	if (stats->max_huge_pages_used < current_huge_pages) {
+		stats->max_huge_pages_used = current_huge_pages;
+	}
+}
+
+// Catches what the last few calls before exit() left in huge pages:
+__attribute__((destructor)) void huge_pages_finish() {
+	if (alloc_init_stage == 3) { huge_pages_tracking(); }
+}
+
+
 void stats_tracking() {
 	void *sbrk_current = sbrk(0);
 	unsigned long current_mem_usage = ((long)sbrk_current - (long)sbrk_start);
@@ -162,6 +241,9 @@ void stats_tracking() {
 	
 	stats->memory_heap_sum += current_mem_usage;
 	stats->memory_uses++;
+
+	// Reading smaps costs microseconds, so huge pages are only sampled:
+	if (stats->memory_uses % 4096 == 1) { huge_pages_tracking(); }
 }
 
 
@@ -239,3 +321,135 @@ void *realloc(void *ptr, size_t size) {
 
 	return addr;
 }
+
+
+/*
+ * Aligned allocations made while the allocator is being loaded come from the
+ * bootstrap buffer, like every other allocation at that stage.
+ */
+int bootstrapping() {
+	if (alloc_init_stage == 0) {
+		stats_alloc_init();
+		return 0;
+	}
+	return alloc_init_stage < 3;
+}
+
+void *buffer_memalign(size_t alignment, size_t size) {
+	buffer = (void *)(((uintptr_t)buffer + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	buffer += size;
+	return buffer - size;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+	if (bootstrapping()) {
+		*memptr = buffer_memalign(alignment, size);
+		return 0;
+	}
+
+	int result = alloc_posix_memalign(memptr, alignment, size);
+	stats_tracking();
+
+	return result;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+	if (bootstrapping()) { return buffer_memalign(alignment, size); }
+
+	void *addr = alloc_aligned_alloc(alignment, size);
+	stats_tracking();
+
+	return addr;
+}
+
+void *memalign(size_t alignment, size_t size) {
+	if (bootstrapping()) { return buffer_memalign(alignment, size); }
+
+	void *addr = alloc_memalign(alignment, size);
+	stats_tracking();
+
+	return addr;
+}
+
+void *valloc(size_t size) {
+	if (bootstrapping()) { return buffer_memalign(sysconf(_SC_PAGESIZE), size); }
+
+	void *addr = alloc_valloc(size);
+	stats_tracking();
+
+	return addr;
+}
+
+void *pvalloc(size_t size) {
+	if (bootstrapping()) { return buffer_memalign(sysconf(_SC_PAGESIZE), size); }
+
+	void *addr = alloc_pvalloc(size);
+	stats_tracking();
+
+	return addr;
+}
+
+
+size_t malloc_usable_size(void *ptr) {
+	if (bootstrapping() || (ptr >= buffer_start && ptr < buffer)) { return 0; }
+
+	size_t size = alloc_malloc_usable_size(ptr);
+	stats_tracking();
+
+	return size;
+}
+
+/*
+ * The sized calls are C23 and may be missing from an older libc. They are
+ * never looked up there, as a failed dlsym() while the shim is bootstrapping
+ * crashes the traced process; mstats-libc frees them with free() instead.
+ */
+void free_sized(void *ptr, size_t size) {
+	if (bootstrapping() || (ptr >= buffer_start && ptr < buffer)) { return; }
+
+	if (ptr) {
+		if (alloc_free_sized) { alloc_free_sized(ptr, size); }
+		else { alloc_free(ptr); }
+		stats_tracking();
+	}
+}
+
+void free_aligned_sized(void *ptr, size_t alignment, size_t size) {
+	if (bootstrapping() || (ptr >= buffer_start && ptr < buffer)) { return; }
+
+	if (ptr) {
+		if (alloc_free_aligned_sized) { alloc_free_aligned_sized(ptr, alignment, size); }
+		else { alloc_free(ptr); }
+		stats_tracking();
+	}
+}
+
+
+/*
+ * libc has no batch calls, so mstats-libc makes one call per object.
+ */
+size_t malloc_batch(size_t size, size_t n, void **out) {
+	if (bootstrapping()) {
+		for (size_t i = 0; i < n; i++) { out[i] = buffer_memalign(16, size); }
+		return n;
+	}
+
+	size_t done = 0;
+	if (alloc_malloc_batch) { done = alloc_malloc_batch(size, n, out); }
+	else { while (done < n && (out[done] = alloc_malloc(size))) { done++; } }
+	stats_tracking();
+
+	return done;
+}
+
+void free_batch(void **ptrs, size_t n) {
+	if (bootstrapping()) { return; }
+
+	if (alloc_free_batch) { alloc_free_batch(ptrs, n); }
+	else {
+		for (size_t i = 0; i < n; i++) {
+			if (ptrs[i] && !(ptrs[i] >= buffer_start && ptrs[i] < buffer)) { alloc_free(ptrs[i]); }
+		}
+	}
+	stats_tracking();
+}
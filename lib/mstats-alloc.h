@@ -4,4 +4,5 @@ typedef struct _alloc_stats_t {
     unsigned long long max_heap_used;
     unsigned long memory_uses;
     unsigned long long memory_heap_sum;
+    unsigned long long max_huge_pages_used;
 } alloc_stats_t;
@@ -202,6 +202,11 @@ int main(int argc, char **argv, char **envp) {
 			char total_time_used[32];
 			sprintf(total_time_used,"%.6f\n",total_time);
 			fputs(total_time_used, result_file);
+
+			// Save peak memory backed by huge pages.
+			char max_huge_pages_used[32];
+			sprintf(max_huge_pages_used,"%llu\n",stats->max_huge_pages_used);
+			fputs(max_huge_pages_used, result_file);
 			
 			fclose(result_file);
 		}
@@ -213,6 +218,7 @@ int main(int argc, char **argv, char **envp) {
 	if (result == 0) { printf("[mstats]: STATUS: OK\n"); }
 	else             { printf("[mstats]: STATUS: FAILED=(%d)\n", result); }
 	printf("[mstats]: MAX: %llu\n", stats->max_heap_used);
+	printf("[mstats]: HUGEPAGES: %llu\n", stats->max_huge_pages_used);
 	
 	if (stats->memory_uses == 0) { printf("[mstats]: AVG: %f\n", 0.0f); }
 	else                         { printf("[mstats]: AVG: %f\n", (stats->memory_heap_sum / (double)stats->memory_uses)); }
@@ -0,0 +1,90 @@
+/**
+ * Batch allocation throughput
+ *
+ * Allocates and frees batches of same-sized nodes, like the dictionary
+ * entries and trie nodes of an LZW encoder, once with malloc_batch() and
+ * free_batch() and once with a malloc() and free() per node. The batch
+ * calls must not be slower than the calls they replace. Each mode is timed
+ * BEST_OF times, alternately, and the best runs are compared.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+size_t malloc_batch(size_t size, size_t n, void **out);
+void free_batch(void **ptrs, size_t n);
+int mallopt(int param, int value);
+
+#ifndef M_TRIM_THRESHOLD
+#define M_TRIM_THRESHOLD -1
+#endif
+
+#define NUM_SIZES 3
+#define BATCH 4096
+#define ROUNDS 200
+#define BEST_OF 5
+#define ALLOWED_RATIO 1.1
+
+static const size_t sizes[NUM_SIZES] = {24, 200, 2064};
+static void *nodes[BATCH];
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Returns the ns taken by ROUNDS batches of `size`-byte nodes.
+static long long run(size_t size, int batched) {
+    long long start = now_ns();
+    for (int round = 0; round < ROUNDS; round++) {
+        if (batched) {
+            if (malloc_batch(size, BATCH, nodes) != BATCH) exit(2);
+        } else {
+            for (size_t i = 0; i < BATCH; i++)
+                if (!(nodes[i] = malloc(size))) exit(2);
+        }
+
+        for (size_t i = 0; i < BATCH; i++)
+            *(size_t *)nodes[i] = i;
+
+        if (batched) {
+            free_batch(nodes, BATCH);
+        } else {
+            for (size_t i = 0; i < BATCH; i++)
+                free(nodes[i]);
+        }
+    }
+    return now_ns() - start;
+}
+
+int main() {
+    // Each round frees megabytes at the top of the heap: trimming them would
+    // time page faults rather than the calls
+    mallopt(M_TRIM_THRESHOLD, 1 << 30);
+
+    int slower = 0;
+    for (int i = 0; i < NUM_SIZES; i++) {
+        // warm up both paths so neither pays for growing the heap
+        run(sizes[i], 0);
+        run(sizes[i], 1);
+
+        long long single = -1, batched = -1;
+        for (int j = 0; j < BEST_OF; j++) {
+            long long t = run(sizes[i], 0);
+            if (single < 0 || t < single) single = t;
+            t = run(sizes[i], 1);
+            if (batched < 0 || t < batched) batched = t;
+        }
+        printf("%5zu bytes: per-object %6.1f ns/node, batch %6.1f ns/node\n", sizes[i],
+               (double)single / (ROUNDS * BATCH), (double)batched / (ROUNDS * BATCH));
+        if (batched > ALLOWED_RATIO * single) slower = 1;
+    }
+
+    if (slower) {
+        fprintf(stderr, "Batch allocation was slower than one call per node!\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * Malloc latency under a growing heap
+ *
+ * Keeps a fragmented working set of live blocks and times every malloc()
+ * and free() of a steady churn. The 99.9th percentile at the largest heap
+ * must stay within a small factor of the one at the smallest heap, which
+ * allows for cache misses, and barely grow from the middle heap, which has
+ * an eighth of its blocks and already misses the cache.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_HEAPS 3
+#define MEASURED_OPS (64 * 1024)
+#define MAX_ALLOC_SIZE 2048
+#define ROUNDS 5
+#define ALLOWED_GROWTH 3
+#define ALLOWED_GROWTH_OUT_OF_CACHE 2
+
+static const size_t heap_blocks[NUM_HEAPS] = {1024, 16 * 1024, 128 * 1024};
+static long long samples[2 * MEASURED_OPS];
+
+static unsigned int seed = 240;
+static size_t next_size() {
+    seed = seed * 1103515245u + 12345u;
+    return 1 + (seed >> 8) % MAX_ALLOC_SIZE;
+}
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compare(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Returns the p99.9 latency in ns of malloc()/free() with `count` live blocks.
+static long long measure(size_t count) {
+    void **live = malloc(count * sizeof(void *));
+    for (size_t i = 0; i < count; i++)
+        live[i] = malloc(next_size());
+
+    // Churn until the free bins reach a steady, fragmented state.
+    for (size_t i = 0; i < 2 * count; i++) {
+        size_t slot = next_size() * count / (MAX_ALLOC_SIZE + 1);
+        free(live[slot]);
+        live[slot] = malloc(next_size());
+    }
+
+    for (size_t i = 0; i < MEASURED_OPS; i++) {
+        size_t slot = next_size() * count / (MAX_ALLOC_SIZE + 1);
+        size_t size = next_size();
+
+        long long start = now_ns();
+        free(live[slot]);
+        long long mid = now_ns();
+        live[slot] = malloc(size);
+        long long end = now_ns();
+
+        memset(live[slot], 0xab, size);
+        samples[2 * i] = mid - start;
+        samples[2 * i + 1] = end - mid;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        free(live[i]);
+    free(live);
+
+    qsort(samples, 2 * MEASURED_OPS, sizeof(long long), compare);
+    return samples[2 * MEASURED_OPS * 999 / 1000];
+}
+
+int main() {
+    // Each heap keeps its best of a few rounds, interleaved with the other
+    // heaps, so that a run the scheduler got in the way of does not count
+    long long p999[NUM_HEAPS];
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < NUM_HEAPS; i++) {
+            long long p = measure(heap_blocks[i]);
+            if (round == 0 || p < p999[i])
+                p999[i] = p;
+        }
+    }
+    for (int i = 0; i < NUM_HEAPS; i++)
+        printf("%7zu live blocks: p99.9 = %lld ns\n", heap_blocks[i], p999[i]);
+
+    long long largest = p999[NUM_HEAPS - 1];
+    if (largest > ALLOWED_GROWTH * p999[0] || largest > ALLOWED_GROWTH_OUT_OF_CACHE * p999[NUM_HEAPS - 2]) {
+        fprintf(stderr, "p99.9 latency grew with the heap!\n");
+        return 1;
+    }
+    return 0;
+}
@@ -7,13 +7,15 @@
 mstats_result * read_mstats_result(const char *filename) {
 	mstats_result *result = (mstats_result *) malloc(sizeof(mstats_result));
 	FILE *f;
+	result->max_huge_pages_used = 0;
 	f = fopen(filename,"r");
 	fscanf(f,
-		"%d\n%llu\n%f\n%f\n",
+		"%d\n%llu\n%f\n%f\n%llu\n",
 			&result->status,
 			&result->max_heap_used,
 			&result->avg_heap_used,
-			&result->time_taken);
+			&result->time_taken,
+			&result->max_huge_pages_used);
 	fclose(f);
 	return result;
 }
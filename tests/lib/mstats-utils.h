@@ -8,6 +8,7 @@ struct _mstats_result {
 	unsigned long long int max_heap_used;
 	float avg_heap_used;
 	float time_taken;
+	unsigned long long int max_huge_pages_used;
 };
 typedef struct _mstats_result mstats_result;
 
@@ -0,0 +1,21 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BURST 64
+#define CHURN 10000
+
+int main() {
+  // A burst of heap blocks that is freed again...
+  void *burst[BURST];
+  for (int i = 0; i < BURST; i++) {
+    burst[i] = malloc(0x8000);
+  }
+  for (int i = 0; i < BURST; i++) {
+    free(burst[i]);
+  }
+
+  // ...followed by a long steady state that only needs a little memory
+  for (int i = 0; i < CHURN; i++) {
+    free(malloc(100));
+  }
+}
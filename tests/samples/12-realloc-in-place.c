@@ -0,0 +1,20 @@
+#include "tester-utils.h"
+
+int main() {
+  // A table that keeps growing, like a doubling array
+  size_t size = 0x400;
+  char *table = malloc(size);
+  memset(table, 'a', size);
+
+  for (size = 0x800; size <= 0x18000; size += 0x400) {
+    char *grown = realloc(table, size);
+    if (grown != table || grown[0] != 'a' || grown[size - 0x401] != 'a') {
+      return 1;
+    }
+    memset(grown, 'a', size);
+    table = grown;
+  }
+
+  free(table);
+  return 0;
+}
@@ -0,0 +1,25 @@
+#include "tester-utils.h"
+
+int main() {
+  char TEST_STRING[] = "Hello world!";
+
+  // Shrinking a block should hand its tail back to the heap...
+  char *a = malloc(0x10000);
+  strcpy(a, TEST_STRING);
+  char *a2 = realloc(a, 0x100);
+  if (a2 != a || strcmp(a2, TEST_STRING) != 0) {
+    return 1;
+  }
+
+  // ...so that it can be reused without growing the heap
+  char *b = malloc(0x8000);
+  char *c = malloc(0x7000);
+  if (b == NULL || c == NULL) {
+    return 1;
+  }
+
+  free(a2);
+  free(b);
+  free(c);
+  return 0;
+}
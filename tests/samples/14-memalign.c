@@ -0,0 +1,58 @@
+#include "tester-utils.h"
+#include <errno.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define ALIGNED(ptr, alignment) (((uintptr_t)(ptr) & ((alignment)-1)) == 0)
+
+int main() {
+  long page = sysconf(_SC_PAGESIZE);
+
+  // Plain allocations are aligned for any type
+  for (size_t size = 1; size <= 0x1000; size += 7) {
+    void *ptr = malloc(size);
+    if (!ALIGNED(ptr, 16)) return 1;
+    free(ptr);
+  }
+
+  // Small objects with strict alignments: the padding in front of each one
+  // goes back to the heap and is reused by the next
+  void *blocks[256];
+  for (size_t i = 0; i < 256; i++) {
+    size_t alignment = 32 << (i % 6);
+    if (posix_memalign(&blocks[i], alignment, 48) || !ALIGNED(blocks[i], alignment))
+      return 2;
+    memset(blocks[i], 'a', 48);
+  }
+  for (size_t i = 0; i < 256; i++) free(blocks[i]);
+
+  void *ptr = NULL;
+  if (posix_memalign(&ptr, 24, 16) != EINVAL || ptr) return 3;
+
+  // One of each entry point, including large and mapped blocks
+  void *aligned = aligned_alloc(64, 1000);
+  void *mem = memalign(0x1000, 0x2000);
+  void *mapped = memalign(0x100000, 0x40000);
+  void *page_block = valloc(10);
+  void *pages = pvalloc(page + 1);
+  if (!ALIGNED(aligned, 64) || !ALIGNED(mem, 0x1000) || !ALIGNED(mapped, 0x100000) ||
+      !ALIGNED(page_block, page) || !ALIGNED(pages, page))
+    return 4;
+  verify_write(aligned, 1000);
+  verify_write(mem, 0x2000);
+  verify_write(mapped, 0x40000);
+  verify_write(page_block, 10);
+  verify_write(pages, 2 * page);
+
+  // Aligned blocks resize and free like any other
+  mem = realloc(mem, 0x3000);
+  mapped = realloc(mapped, 0x80000);
+  if (((char *)mem)[0] != START_CHAR || ((char *)mapped)[0] != START_CHAR) return 5;
+  free(aligned);
+  free(mem);
+  free(mapped);
+  free(page_block);
+  free(pages);
+  return 0;
+}
@@ -0,0 +1,51 @@
+#include "tester-utils.h"
+#include <malloc.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// C23, not yet provided by every libc: resolved at run time from the
+// allocator that mstats loads
+void free_sized(void *ptr, size_t size) __attribute__((weak));
+void free_aligned_sized(void *ptr, size_t alignment, size_t size) __attribute__((weak));
+
+int main() {
+  if (!free_sized || !free_aligned_sized) return 6;
+
+  // The slack past each request is usable, and growing into it is free
+  for (size_t size = 1; size <= 0x2000; size = size * 3 / 2 + 1) {
+    char *ptr = malloc(size);
+    size_t usable = malloc_usable_size(ptr);
+    if (usable < size) return 1;
+    memset(ptr, 'a', usable);
+    if (realloc(ptr, usable) != ptr || ptr[usable - 1] != 'a') return 2;
+    free_sized(ptr, usable);
+  }
+  if (malloc_usable_size(NULL) != 0) return 3;
+
+  // Many small objects freed with their sizes are reused
+  for (int round = 0; round < 4; round++) {
+    void *objects[1000];
+    for (size_t i = 0; i < 1000; i++) objects[i] = malloc(16 + i % 512);
+    for (size_t i = 0; i < 1000; i++) free_sized(objects[i], 16 + i % 512);
+  }
+
+  char *mapped = malloc(0x100000);
+  if (malloc_usable_size(mapped) < 0x100000) return 4;
+  verify_write(mapped, 0x100000);
+  free_sized(mapped, 0x100000);
+
+  void *aligned = aligned_alloc(256, 1000);
+  if (malloc_usable_size(aligned) < 1000) return 5;
+  free_aligned_sized(aligned, 256, 1000);
+
+  // A size the block cannot hold aborts in the debug builds the tests use
+  pid_t child = fork();
+  if (child == 0) {
+    free_sized(malloc(100), 0x1000);
+    _exit(0);
+  }
+  int status;
+  if (waitpid(child, &status, 0) != child || !WIFSIGNALED(status) || WTERMSIG(status) != SIGABRT) return 7;
+  return 0;
+}
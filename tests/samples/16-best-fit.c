@@ -0,0 +1,35 @@
+#include "tester-utils.h"
+
+#define HOLES 16
+
+int main() {
+  // Holes of two sizes between blocks that stay in use, the larger holes
+  // freed first
+  void *large[HOLES], *small[HOLES], *used[2 * HOLES];
+  for (int i = 0; i < HOLES; i++) {
+    large[i] = malloc(0x7000);
+    used[2 * i] = malloc(0x400);
+    small[i] = malloc(0x4000);
+    used[2 * i + 1] = malloc(0x400);
+  }
+  for (int i = 0; i < HOLES; i++) free(large[i]);
+  for (int i = 0; i < HOLES; i++) free(small[i]);
+
+  // Every request has a hole of exactly its size: a small request that
+  // splits a large hole leaves the large request nowhere to go
+  for (int i = 0; i < HOLES; i++) {
+    small[i] = malloc(0x4000);
+    verify_write(small[i], 0x4000);
+  }
+  for (int i = 0; i < HOLES; i++) {
+    large[i] = malloc(0x7000);
+    verify_write(large[i], 0x7000);
+  }
+
+  for (int i = 0; i < HOLES; i++) {
+    free(small[i]);
+    free(large[i]);
+  }
+  for (int i = 0; i < 2 * HOLES; i++) free(used[i]);
+  return 0;
+}
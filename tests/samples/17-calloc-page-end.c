@@ -0,0 +1,36 @@
+#include "tester-utils.h"
+#include <malloc.h>
+#include <stdint.h>
+
+#define BLOCK_SIZE 100000
+#define PAGE_OFFSET 0xff0
+
+int main() {
+  // Pad the heap so that the payload of a large block starts just short of
+  // a page end
+  char *probe = malloc(0x1000);
+  uintptr_t next = (uintptr_t) probe + malloc_usable_size(probe) + sizeof(size_t);
+  void *pad = malloc(((PAGE_OFFSET - next) & 0xfff) + 0x1000 - sizeof(size_t));
+  char *block = malloc(BLOCK_SIZE);
+  void *guard = malloc(BLOCK_SIZE);
+  if (((uintptr_t) block & 0xfff) != PAGE_OFFSET) return 1;
+
+  // Once purged, calloc clears the partial page under the free block's
+  // links, which must stop at the end of the request rather than run into
+  // the block split off after it
+  free(block);
+  malloc_trim(0);
+  char *zeroed = calloc(1, 0x1000);
+  if (zeroed != block) return 2;
+  verify(zeroed, 0, 0x1000);
+  char *neighbour = malloc(0x1000);
+  verify_write(neighbour, 0x1000);
+  if (!verify_read(neighbour, 0x1000)) return 3;
+
+  free(zeroed);
+  free(neighbour);
+  free(guard);
+  free(pad);
+  free(probe);
+  return 0;
+}
@@ -0,0 +1,29 @@
+#include "tester-utils.h"
+#include <unistd.h>
+
+#define FOREIGN_SIZE (64 * K)
+#define NUM_BLOCKS 256
+#define BLOCK_SIZE (4 * K)
+
+int main() {
+  void *first = malloc(BLOCK_SIZE);
+
+  // Another user of the heap moves the break past the allocator's top
+  char *foreign = sbrk(FOREIGN_SIZE);
+  if (foreign == (void *) -1) return 1;
+  memset(foreign, 'f', FOREIGN_SIZE);
+
+  // The allocator must not grow its heap over memory it does not own
+  char *blocks[NUM_BLOCKS];
+  for (int i = 0; i < NUM_BLOCKS; i++) {
+    blocks[i] = malloc(BLOCK_SIZE);
+    if (blocks[i] == NULL) return 2;
+    if (overlap(blocks[i], BLOCK_SIZE, foreign, FOREIGN_SIZE)) return 3;
+    memset(blocks[i], 'a', BLOCK_SIZE);
+  }
+  verify(foreign, 'f', FOREIGN_SIZE);
+
+  for (int i = 0; i < NUM_BLOCKS; i++) free(blocks[i]);
+  free(first);
+  return 0;
+}
@@ -124,3 +124,87 @@ TEST_CASE("10-free-lists - Free Lists", "[weight=25][part=4]") {
   REQUIRE(result->time_taken < 3);
   system("rm mstats_result.txt");
 }
+
+// HEAP TRIMMING
+TEST_CASE("11-heap-trim - Freed memory at the top of the heap is released", "[weight=10][part=6]") {
+  system("make -s");
+  system("./mstats tests/samples_exe/11-heap-trim evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->max_heap_used > 64 * 0x8000);
+  REQUIRE(result->avg_heap_used < result->max_heap_used / 10);
+  system("rm mstats_result.txt");
+}
+
+// IN-PLACE REALLOC
+TEST_CASE("12-realloc-in-place - A growing block at the top of the heap is not copied", "[weight=10][part=6]") {
+  system("make -s");
+  system("./mstats tests/samples_exe/12-realloc-in-place evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->max_heap_used < 0x30000);
+  REQUIRE(result->max_heap_used > 0);
+  system("rm mstats_result.txt");
+}
+
+// SHRINKING REALLOC
+TEST_CASE("13-realloc-shrink - The tail of a shrunk block is reused", "[weight=10][part=6]") {
+  system("make -s");
+  system("./mstats tests/samples_exe/13-realloc-shrink evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->max_heap_used < 0x10100);
+  REQUIRE(result->max_heap_used > 0);
+  system("rm mstats_result.txt");
+}
+
+// ALIGNED ALLOCATION
+TEST_CASE("14-memalign - Aligned blocks give their padding back to the heap", "[weight=10][part=6]") {
+  system("make -s");
+  system("./mstats tests/samples_exe/14-memalign evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->max_heap_used < 0x20000);
+  REQUIRE(result->max_heap_used > 0);
+  system("rm mstats_result.txt");
+}
+
+// USABLE SIZE AND SIZED FREE
+TEST_CASE("15-usable-size - The slack of a block is usable and sized frees reuse memory", "[weight=10][part=6]") {
+  system("make -s");
+  system("./mstats tests/samples_exe/15-usable-size evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->max_heap_used < 0x80000);
+  REQUIRE(result->max_heap_used > 0);
+  system("rm mstats_result.txt");
+}
+
+// BEST FIT
+TEST_CASE("16-best-fit - Requests take the hole that fits them best", "[weight=10][part=6]") {
+  system("make -s");
+  system("./mstats tests/samples_exe/16-best-fit evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->max_heap_used < 0xD0000);
+  REQUIRE(result->max_heap_used > 0);
+  system("rm mstats_result.txt");
+}
+
+TEST_CASE("17-calloc-page-end - calloc of a purged block spares the block after it", "[weight=5][part=6]") {
+  system("make -s");
+  system("./mstats tests/samples_exe/17-calloc-page-end evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->max_heap_used > 0);
+  system("rm mstats_result.txt");
+}
+
+TEST_CASE("18-foreign-sbrk - The heap never grows over a break moved by someone else", "[weight=5][part=6]") {
+  system("make -s");
+  system("./mstats tests/samples_exe/18-foreign-sbrk evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->max_heap_used > 0);
+  system("rm mstats_result.txt");
+}
@@ -60,3 +60,27 @@ TEST_CASE("tester5", "[weight=20][part=5][suite=week2][timeout=30]") {
   system("rm mstats_result.txt");
   REQUIRE(result->status == 1);
 }
+
+TEST_CASE("tester6", "[weight=20][part=5][suite=week2][timeout=30]") {
+  system("make -s");
+  system("./mstats tests/testers_exe/tester6 evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  system("rm mstats_result.txt");
+  REQUIRE(result->status == 1);
+}
+
+TEST_CASE("tester7", "[weight=10][part=5][suite=week2][timeout=30]") {
+  system("make -s");
+  system("./mstats tests/testers_exe/tester7 evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  system("rm mstats_result.txt");
+  REQUIRE(result->status == 1);
+}
+
+TEST_CASE("tester10", "[weight=10][part=5][suite=week2][timeout=30]") {
+  system("make -s");
+  system("./mstats tests/testers_exe/tester10 evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  system("rm mstats_result.txt");
+  REQUIRE(result->status == 1);
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/catch.hpp"
+#include "lib/mstats-utils.h"
+
+// Transparent huge pages can back madvise(MADV_HUGEPAGE) memory unless the
+// system has them set to "never".
+static int transparent_huge_pages() {
+  FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+  if (!f) return 0;
+  char mode[128] = "";
+  fgets(mode, sizeof(mode), f);
+  fclose(f);
+  return strstr(mode, "[never]") == NULL;
+}
+
+// Allocator performance
+TEST_CASE("latency/malloc-latency - TLSF p99.9 stays flat as the heap grows", "[weight=10][part=6][suite=week3][timeout=30]") {
+  system("make -s");
+  REQUIRE( system("./tests/latency_exe/malloc-latency") == 0 );
+}
+
+TEST_CASE("latency/batch-alloc - Batch calls beat one call per node", "[weight=10][part=6][suite=week3][timeout=30]") {
+  system("make -s");
+  REQUIRE( system("./tests/latency_exe/batch-alloc") == 0 );
+}
+
+TEST_CASE("tester8 - Growing a huge block does not copy it", "[weight=10][part=6][suite=week3][timeout=30]") {
+  system("make -s");
+  system("./mstats tests/testers_exe/tester8 evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  system("rm mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->time_taken < 1);
+}
+
+TEST_CASE("tester9 - calloc does not clear memory that is already zero", "[weight=10][part=6][suite=week3][timeout=30]") {
+  system("make -s");
+  system("./mstats tests/testers_exe/tester9 evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  system("rm mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->time_taken < 1);
+}
+
+TEST_CASE("tester11 - Bursts of small frees are reused without coalescing", "[weight=10][part=6][suite=week3][timeout=30]") {
+  system("make -s");
+  system("./mstats tests/testers_exe/tester11 evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  system("rm mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->time_taken < 1);
+}
+
+TEST_CASE("tester12 - A fresh heap is filled straight off its top", "[weight=10][part=6][suite=week3][timeout=30]") {
+  system("make -s");
+  system("./mstats tests/testers_exe/tester12 evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  system("rm mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->time_taken < 0.5);
+}
+
+TEST_CASE("tester4 - Heaps laid out for huge pages (ALLOC_HUGEPAGES=1)", "[weight=10][part=6][suite=week3][timeout=30]") {
+  system("make -s");
+  system("ALLOC_HUGEPAGES=1 ./mstats tests/testers_exe/tester4 evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  system("rm mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->time_taken < 1);
+  if (transparent_huge_pages()) REQUIRE(result->max_huge_pages_used > 0);
+}
+
+TEST_CASE("17-calloc-page-end - calloc clears the partial huge pages a purge leaves (ALLOC_HUGEPAGES=1)", "[weight=5][part=6][suite=week3][timeout=30]") {
+  system("make -s");
+  system("ALLOC_HUGEPAGES=1 ./mstats tests/samples_exe/17-calloc-page-end evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  system("rm mstats_result.txt");
+  REQUIRE(result->status == 1);
+}
+
+TEST_CASE("tester13 - Tuned at run time through ALLOC_CONF", "[weight=10][part=6][suite=week3][timeout=30]") {
+  system("make -s");
+  system("ALLOC_CONF=class_spacing:256,mmap_threshold:64k,tcache:64,arenas:2,decay_ms:0 ./mstats tests/testers_exe/tester13 evaluate");
+  mstats_result * result = read_mstats_result("mstats_result.txt");
+  system("rm mstats_result.txt");
+  REQUIRE(result->status == 1);
+  REQUIRE(result->time_taken < 1);
+}
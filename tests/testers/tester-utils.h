@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #define K 1024L
 #define M (1024L * 1024L)
@@ -28,6 +29,18 @@ int overlap(void *r1, size_t len1, void *r2, size_t len2) {
            ((size_t)r2 <= (size_t)r1 && (size_t)r1 < (size_t)(r2 + len2));
 }
 
+// Resident set size of the process in bytes
+long resident() {
+    long pages = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(statm);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
 #define START_CHAR 'e'
 #define END_CHAR 'l'
 
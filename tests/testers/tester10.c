@@ -0,0 +1,38 @@
+#include <stdint.h>
+#include "tester-utils.h"
+
+#define NUM_OBJECTS (1024 * 1024)
+
+// Tiny objects should cost little more than their own size, and the memory
+// of one size should serve another once it has been freed.
+int main() {
+    static uint64_t *objects[NUM_OBJECTS];
+    memset(objects, 0, sizeof(objects));
+    for (int round = 0; round < 2; round++) {
+        size_t size = round == 0 ? 16 : 8;
+        long before = resident();
+        for (size_t i = 0; i < NUM_OBJECTS; i++) {
+            objects[i] = malloc(size);
+            if (objects[i] == NULL) {
+                fprintf(stderr, "Memory failed to allocate!\n");
+                return 1;
+            }
+            *objects[i] = i;
+        }
+        long used = resident() - before;
+        for (size_t i = 0; i < NUM_OBJECTS; i++) {
+            if (*objects[i] != i) {
+                fprintf(stderr, "Memory was corrupted!\n");
+                return 2;
+            }
+            free(objects[i]);
+        }
+        if (used > NUM_OBJECTS * 24) {
+            fprintf(stderr, "%zu-byte objects cost %ld bytes each\n", size, used / NUM_OBJECTS);
+            return 3;
+        }
+    }
+
+    fprintf(stderr, "Memory was allocated, used, and freed!\n");
+    return 0;
+}
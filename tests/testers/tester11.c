@@ -0,0 +1,33 @@
+#include "tester-utils.h"
+
+#define NUM_ROUNDS 1000
+#define BURST 4096
+
+// Allocates bursts of small nodes and frees each burst out of order, far
+// more than the thread cache holds. The freed blocks must be reusable by the
+// next burst without being merged and split again every time.
+void *nodes[BURST];
+
+int main() {
+    for (int round = 0; round < NUM_ROUNDS; round++) {
+        for (int i = 0; i < BURST; i++) {
+            nodes[i] = malloc(300 + (i % 4) * 16);
+            if (nodes[i] == NULL) {
+                fprintf(stderr, "Memory failed to allocate!\n");
+                return 1;
+            }
+            *(int *)nodes[i] = i;
+        }
+        for (int i = 0; i < BURST; i++) {
+            int *node = nodes[(i * 7) % BURST];
+            if (*node != (i * 7) % BURST) {
+                fprintf(stderr, "Memory failed to contain correct data!\n");
+                return 2;
+            }
+            free(node);
+        }
+    }
+
+    fprintf(stderr, "Memory was allocated, used, and freed!\n");
+    return 0;
+}
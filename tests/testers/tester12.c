@@ -0,0 +1,29 @@
+#include "tester-utils.h"
+
+#define NUM_BLOCKS (256 * 1024)
+
+// Fills a fresh heap with small blocks that are never freed, as a program's
+// start-up does. With no free block to search, every malloc() should come
+// straight off the top of the heap.
+void *blocks[NUM_BLOCKS];
+
+int main() {
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        blocks[i] = malloc(300 + (i % 4) * 16);
+        if (blocks[i] == NULL) {
+            fprintf(stderr, "Memory failed to allocate!\n");
+            return 1;
+        }
+        *(int *)blocks[i] = i;
+    }
+
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        if (*(int *)blocks[i] != i) {
+            fprintf(stderr, "Memory failed to contain correct data!\n");
+            return 2;
+        }
+    }
+
+    fprintf(stderr, "Memory was allocated, used, and freed!\n");
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include "tester-utils.h"
+#include <malloc.h>
+#include <unistd.h>
+
+#define NUM_ROUNDS 200
+#define BURST 1024
+
+// Runs with ALLOC_CONF=class_spacing:256,mmap_threshold:64k,tcache:64,
+// arenas:2,decay_ms:0 and checks that the allocator was tuned by it: block
+// sizes step by 256 bytes, and a 100 KiB request gets a mapping of its own.
+void *nodes[BURST];
+
+int main() {
+    void *block = malloc(300);
+    if (block == NULL || malloc_usable_size(block) != 2 * 256 - 8) {
+        fprintf(stderr, "Block sizes do not follow class_spacing!\n");
+        return 1;
+    }
+    free(block);
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    void *mapped = malloc(100 * K);
+    if (mapped == NULL || (malloc_usable_size(mapped) + 16) % page_size != 0) {
+        fprintf(stderr, "Request above mmap_threshold was not mapped!\n");
+        return 2;
+    }
+    free(mapped);
+
+    for (int round = 0; round < NUM_ROUNDS; round++) {
+        for (int i = 0; i < BURST; i++) {
+            nodes[i] = malloc(24 + (i % 64) * 40);
+            if (nodes[i] == NULL) {
+                fprintf(stderr, "Memory failed to allocate!\n");
+                return 3;
+            }
+            *(int *)nodes[i] = i;
+        }
+        for (int i = 0; i < BURST; i++) {
+            int *node = nodes[(i * 7) % BURST];
+            if (*node != (i * 7) % BURST) {
+                fprintf(stderr, "Memory failed to contain correct data!\n");
+                return 4;
+            }
+            free(node);
+        }
+    }
+
+    fprintf(stderr, "Memory was allocated, used, and freed!\n");
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <pthread.h>
+#include "tester-utils.h"
+
+#define NUM_THREADS 8
+#define NUM_CYCLES 100000
+#define SLOTS 64
+
+// Each thread churns its own slots and also frees blocks allocated by its
+// neighbour, so blocks regularly cross threads.
+void *shared[NUM_THREADS][SLOTS];
+
+void *churn(void *arg) {
+    long id = (long)arg;
+    unsigned int seed = id;
+    char *mine[SLOTS] = {NULL};
+    size_t sizes[SLOTS] = {0};
+
+    for (int i = 0; i < NUM_CYCLES; i++) {
+        int slot = rand_r(&seed) % SLOTS;
+        if (mine[slot]) {
+            if (!verify_read(mine[slot], sizes[slot]))
+                exit(2);
+            free(mine[slot]);
+        }
+
+        sizes[slot] = 2 + (rand_r(&seed) % 8 == 0 ? rand_r(&seed) % (16 * K) : rand_r(&seed) % 256);
+        mine[slot] = malloc(sizes[slot]);
+        if (mine[slot] == NULL) {
+            fprintf(stderr, "Memory failed to allocate!\n");
+            exit(1);
+        }
+        verify_write(mine[slot], sizes[slot]);
+
+        void *old = __atomic_exchange_n(&shared[(id + 1) % NUM_THREADS][slot], malloc(32), __ATOMIC_ACQ_REL);
+        free(old);
+    }
+
+    for (int slot = 0; slot < SLOTS; slot++)
+        free(mine[slot]);
+    return NULL;
+}
+
+int main() {
+    pthread_t threads[NUM_THREADS];
+    for (long i = 0; i < NUM_THREADS; i++)
+        pthread_create(&threads[i], NULL, churn, (void *)i);
+    for (int i = 0; i < NUM_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < NUM_THREADS; i++)
+        for (int slot = 0; slot < SLOTS; slot++)
+            free(shared[i][slot]);
+
+    fprintf(stderr, "Memory was allocated, used, and freed across threads!\n");
+    return 0;
+}
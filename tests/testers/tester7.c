@@ -0,0 +1,55 @@
+#include "tester-utils.h"
+
+#define NUM_BLOCKS 64
+#define BLOCK_SIZE (96 * K)
+
+// Frees a large working set in the middle of the heap, waits for it to decay
+// and expects its pages to be returned to the OS without losing the blocks.
+int main() {
+    void *trigger = malloc(BLOCK_SIZE);
+    void *guard_low = malloc(64);
+    char *blocks[NUM_BLOCKS];
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < NUM_BLOCKS; i++) {
+            blocks[i] = malloc(BLOCK_SIZE);
+            if (blocks[i] == NULL) {
+                fprintf(stderr, "Memory failed to allocate!\n");
+                return 1;
+            }
+            memset(blocks[i], 'a' + round, BLOCK_SIZE);
+            verify_write(blocks[i], BLOCK_SIZE);
+        }
+        for (int i = 0; i < NUM_BLOCKS; i++) {
+            if (!verify_read(blocks[i], BLOCK_SIZE) || blocks[i][BLOCK_SIZE / 2] != 'a' + round) {
+                fprintf(stderr, "Memory was corrupted!\n");
+                return 1;
+            }
+        }
+        void *guard_high = malloc(64);
+        long before = resident();
+        for (int i = 0; i < NUM_BLOCKS; i++)
+            free(blocks[i]);
+
+        // The next large free after the decay period purges the working set,
+        // and so does the next malloc when nothing is freed
+        usleep(1500 * 1000);
+        if (round == 0)
+            free(trigger);
+        void *next = malloc(BLOCK_SIZE);
+        if (round == 0)
+            trigger = next;
+        else
+            free(next);
+        long after = resident();
+        if (after > before - NUM_BLOCKS * BLOCK_SIZE / 2) {
+            fprintf(stderr, "Free pages were not returned: %ld -> %ld\n", before, after);
+            return 1;
+        }
+        free(guard_high);
+    }
+    free(trigger);
+    free(guard_low);
+
+    fprintf(stderr, "Memory was allocated, used, and freed!\n");
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include "tester-utils.h"
+
+#define START_SIZE (1 * M)
+#define END_SIZE (256 * M)
+#define STEP (1 * M)
+
+// Grows a huge buffer a little at a time. Each step must keep the data
+// already written without copying the whole buffer again.
+int main() {
+    size_t size = START_SIZE;
+    char *buffer = malloc(size);
+    if (buffer == NULL) {
+        fprintf(stderr, "Memory failed to allocate!\n");
+        return 1;
+    }
+    verify_write(buffer, size);
+
+    for (size = START_SIZE + STEP; size <= END_SIZE; size += STEP) {
+        buffer = realloc(buffer, size);
+        if (buffer == NULL) {
+            fprintf(stderr, "Memory failed to allocate!\n");
+            return 1;
+        }
+        if (*buffer != START_CHAR || buffer[size - STEP - 1] != END_CHAR) {
+            fprintf(stderr, "Memory failed to contain correct data after realloc()!\n");
+            return 2;
+        }
+        buffer[size - 1] = END_CHAR;
+    }
+    free(buffer);
+
+    fprintf(stderr, "Memory was allocated, used, and freed!\n");
+    return 0;
+}
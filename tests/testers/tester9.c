@@ -0,0 +1,35 @@
+#include "tester-utils.h"
+
+#define NUM_CYCLES 100
+#define BLOCK_SIZE (64 * M)
+#define STRIDE (64 * K)
+
+// Allocates large zeroed frame buffers over and over. Memory fresh from the
+// OS is already zero, so this should not cost a pass over every page.
+int main() {
+    for (int i = 0; i < NUM_CYCLES; i++) {
+        char *frame = calloc(BLOCK_SIZE / 4, 4);
+        if (frame == NULL) {
+            fprintf(stderr, "Memory failed to allocate!\n");
+            return 1;
+        }
+
+        for (size_t j = 0; j < BLOCK_SIZE; j += STRIDE) {
+            if (frame[j] != 0 || frame[j + STRIDE - 1] != 0) {
+                fprintf(stderr, "Memory was not zeroed!\n");
+                return 2;
+            }
+            frame[j] = frame[j + STRIDE - 1] = 1;
+        }
+        free(frame);
+    }
+
+    volatile size_t huge = (size_t)-1 / 2;
+    if (calloc(huge, 4) != NULL) {
+        fprintf(stderr, "calloc() did not catch an overflow!\n");
+        return 3;
+    }
+
+    fprintf(stderr, "Memory was allocated, used, and freed!\n");
+    return 0;
+}